@@ -0,0 +1,562 @@
+/*
+  ==============================================================================
+
+    Batch freezer: renders a frozen sustain at each of many points across a
+    folder of recordings, e.g. every note onset of a set of solos to transcribe.
+
+    usage: AudioFreezeFrameBatch <folder> <points|--onsets> <outdir> [options]
+        --length <ms>     freeze length (default 750)
+        --hold <s>        seconds rendered from each point (default 4)
+        --jobs <n>        render threads (default one per core)
+        --threshold <dB>  with --onsets, the jump in level between 512 sample
+                          frames that counts as an onset (default 9)
+        --shared-phase    one random phase field for all channels
+        --seed <n>        draw the random phases from seed n, so each point
+                          renders the same whichever job picks it up
+
+    The points file has one "<file> <seconds>" per line, the file relative to
+    the folder. Blank lines and lines starting with '#' are ignored. With
+    --onsets every audio file in the folder is scanned for onsets instead.
+    Each point is written to <outdir>/<file name>_<seconds>s.wav, the extension
+    kept so take.wav and take.aiff don't overwrite each other; a point that
+    would write the same name twice is only rendered once.
+
+    Every file is decoded once, front to back, keeping only the audio around
+    each point: a full freeze length before it and the forecast after. Those
+    snapshots go through a bounded queue to a pool of render jobs, each with
+    its own FreezeEngine doing exactly what the app does: play up to the
+    point, freeze, and record the forecast, crossfade and frozen loop. Memory
+    stays at a few snapshots per thread however long or many the files are.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include <deque>
+#include <map>
+#include <set>
+#include "../../Source/FreezeEngine.h"
+#include "../../Source/FreezeKernels.h"
+
+//==============================================================================
+struct BatchSettings
+{
+    double lengthMs = 750.0;
+    double holdSeconds = 4.0;
+    float thresholdDb = 9.0f;
+    bool sharedPhase = false;
+    bool seeded = false;
+    juce::int64 seed = 0;
+};
+
+// the audio around one point, with the point itself at index `preroll`,
+// which is also the freeze length at this file's sample rate
+struct Snapshot
+{
+    juce::File output;
+    juce::AudioSampleBuffer audio;
+    double sampleRate = 0.0;
+    int preroll = 0;
+    int filled = 0;
+};
+
+// samples per process() call, as a device would call it
+static constexpr int renderBlock = 512;
+
+//==============================================================================
+/*
+    Hands snapshots from the reader to the render jobs. push() blocks while
+    `capacity` snapshots are already waiting, which is what bounds memory when
+    decoding outruns rendering.
+*/
+class SnapshotQueue
+{
+public:
+    explicit SnapshotQueue(int capacityToUse)
+        : capacity(capacityToUse),
+          finished(false)
+    {
+    }
+
+    void push(std::unique_ptr<Snapshot> snapshot)
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl(lock);
+                if (static_cast<int>(items.size()) < capacity)
+                {
+                    items.push_back(std::move(snapshot));
+                    break;
+                }
+            }
+            spaceAvailable.wait(100);
+        }
+
+        itemAvailable.signal();
+    }
+
+    // no more snapshots are coming; the jobs drain what is left and finish
+    void finish()
+    {
+        {
+            const juce::ScopedLock sl(lock);
+            finished = true;
+        }
+        itemAvailable.signal();
+    }
+
+    // waits for the next snapshot, or returns null once finished and empty
+    std::unique_ptr<Snapshot> pop()
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock sl(lock);
+                if (! items.empty())
+                {
+                    std::unique_ptr<Snapshot> snapshot = std::move(items.front());
+                    items.pop_front();
+                    spaceAvailable.signal();
+                    return snapshot;
+                }
+                if (finished) return nullptr;
+            }
+            itemAvailable.wait(100);
+        }
+    }
+
+private:
+    juce::CriticalSection lock;
+    std::deque<std::unique_ptr<Snapshot>> items;
+    juce::WaitableEvent itemAvailable;
+    juce::WaitableEvent spaceAvailable;
+    int capacity;
+    bool finished;
+
+    JUCE_DECLARE_NON_COPYABLE (SnapshotQueue)
+};
+
+//==============================================================================
+/*
+    One render thread's worth of work: takes snapshots off the queue until it
+    is finished, reusing one engine for all of them.
+*/
+class RenderJob  : public juce::ThreadPoolJob
+{
+public:
+    RenderJob(SnapshotQueue& queueToUse, const BatchSettings& settingsToUse)
+        : juce::ThreadPoolJob("Batch render"),
+          queue(queueToUse),
+          settings(settingsToUse),
+          preparedChannels(0),
+          preparedSamples(0),
+          numRendered(0),
+          numFailed(0)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        while (auto snapshot = queue.pop())
+        {
+            if (shouldExit()) break;
+
+            if (render(*snapshot)) ++numRendered;
+            else ++numFailed;
+        }
+
+        return jobHasFinished;
+    }
+
+    int getNumRendered() const { return numRendered; }
+    int getNumFailed() const { return numFailed; }
+
+private:
+    bool render(Snapshot& snapshot)
+    {
+        int numChannels = snapshot.audio.getNumChannels();
+
+        // synchronous, so every render comes out the same however busy the machine is.
+        // with a seed the phases start over for each point, as they would on a fresh engine
+        if (settings.seeded || numChannels != preparedChannels || snapshot.preroll != preparedSamples)
+        {
+            engine.setPrerenderedLoop(true);
+            engine.setSharedPhase(settings.sharedPhase);
+            if (settings.seeded)
+                engine.setPhaseSeed(static_cast<juce::uint64>(settings.seed));
+            engine.prepare(numChannels, snapshot.preroll, true);
+            preparedChannels = numChannels;
+            preparedSamples = snapshot.preroll;
+        }
+        else
+        {
+            // the preroll overwrites the whole ring, so dropping the last freeze is enough
+            engine.cancel();
+        }
+
+        juce::MemoryAudioSource source(snapshot.audio, false);
+        source.prepareToPlay(renderBlock, snapshot.sampleRate);
+        engine.setSource(&source);
+
+        snapshot.output.deleteFile();
+        juce::WavAudioFormat wavFormat;
+        std::unique_ptr<juce::FileOutputStream> stream(new juce::FileOutputStream(snapshot.output));
+        std::unique_ptr<juce::AudioFormatWriter> writer;
+        if (stream->openedOk())
+            writer.reset(wavFormat.createWriterFor(stream.get(), snapshot.sampleRate,
+                                                   static_cast<unsigned int>(numChannels), 24, {}, 0));
+        // the writer owns the stream once it exists
+        if (writer != nullptr)
+            stream.release();
+        bool written = writer != nullptr;
+
+        if (written)
+        {
+            juce::AudioSampleBuffer block(numChannels, renderBlock);
+
+            // fill the ring right up to the point, then freeze exactly on it
+            for (int done = 0; done < snapshot.preroll; )
+            {
+                int numSamples = juce::jmin(renderBlock, snapshot.preroll - done);
+                engine.process(juce::AudioSourceChannelInfo(&block, 0, numSamples));
+                done += numSamples;
+            }
+
+            engine.freeze();
+
+            auto holdSamples = static_cast<juce::int64>(settings.holdSeconds * snapshot.sampleRate);
+            for (juce::int64 done = 0; done < holdSamples && written; )
+            {
+                int numSamples = static_cast<int>(juce::jmin(static_cast<juce::int64>(renderBlock), holdSamples - done));
+                engine.process(juce::AudioSourceChannelInfo(&block, 0, numSamples));
+                written = writer->writeFromAudioSampleBuffer(block, 0, numSamples);
+                done += numSamples;
+            }
+        }
+
+        engine.setSource(nullptr);
+
+        if (! written)
+            std::cerr << "can't write " << snapshot.output.getFullPathName() << std::endl;
+        return written;
+    }
+
+    SnapshotQueue& queue;
+    const BatchSettings& settings;
+    FreezeEngine engine;
+    int preparedChannels;
+    int preparedSamples;
+    int numRendered;
+    int numFailed;
+
+    JUCE_DECLARE_NON_COPYABLE (RenderJob)
+};
+
+//==============================================================================
+/*
+    Level-jump onset detection on consecutive frames: a frame that comes in
+    `thresholdDb` louder than the one before, above a noise floor, and far
+    enough from the last onset that the two freezes would not overlap.
+*/
+class OnsetDetector
+{
+public:
+    OnsetDetector(float thresholdDbToUse, int minSpacingToUse)
+        : thresholdDb(thresholdDbToUse),
+          minSpacing(minSpacingToUse),
+          previousDb(-100.0f),
+          sinceOnset(minSpacingToUse)
+    {
+    }
+
+    bool isOnset(const juce::AudioSampleBuffer& frame, int numSamples)
+    {
+        float power = 0.0f;
+        for (int channel = 0; channel < frame.getNumChannels(); ++channel)
+            power += juce::square(frame.getRMSLevel(channel, 0, numSamples));
+        float levelDb = juce::Decibels::gainToDecibels(std::sqrt(power / frame.getNumChannels()), -100.0f);
+
+        bool onset = levelDb > floorDb && levelDb - previousDb >= thresholdDb && sinceOnset >= minSpacing;
+        previousDb = levelDb;
+        sinceOnset = onset ? numSamples : sinceOnset + numSamples;
+        return onset;
+    }
+
+private:
+    static constexpr float floorDb = -50.0f;
+
+    float thresholdDb;
+    int minSpacing;
+    float previousDb;
+    int sinceOnset;
+};
+
+//==============================================================================
+/*
+    Streams one file front to back, keeping the last freeze length of audio
+    so any point can be snapshotted the moment the reader gets to it. Points
+    past the end of the file are skipped. Returns the number of snapshots.
+*/
+static int extractSnapshots(juce::AudioFormatReader& reader, const juce::File& file, const juce::File& outputDir,
+                            std::vector<double> points, bool detectOnsets,
+                            const BatchSettings& settings, SnapshotQueue& queue)
+{
+    int numChannels = static_cast<int>(reader.numChannels);
+    double sampleRate = reader.sampleRate;
+    juce::int64 length = reader.lengthInSamples;
+    // the freeze length is in time, so it follows each file's sample rate
+    int preroll = juce::roundToInt(settings.lengthMs * sampleRate / 1000.0);
+    preroll = juce::jmax(1024, preroll + (preroll & 1));
+    // the forecast reads exactly half a ring past the point
+    int snapshotLength = preroll + preroll / 2;
+
+    std::sort(points.begin(), points.end());
+    std::vector<juce::int64> pointSamples;
+    for (double seconds : points)
+        pointSamples.push_back(static_cast<juce::int64>(seconds * sampleRate));
+    size_t nextPoint = 0;
+
+    juce::AudioSampleBuffer history(numChannels, preroll);
+    int historyIndex = 0;
+    int historyFilled = 0;
+    history.clear();
+
+    juce::AudioSampleBuffer chunk(numChannels, renderBlock);
+    std::vector<std::unique_ptr<Snapshot>> active;
+    OnsetDetector detector(settings.thresholdDb, preroll / 2);
+    std::set<juce::String> outputNames;
+    int numSnapshots = 0;
+
+    auto startSnapshot = [&] (juce::int64 pos)
+    {
+        // a repeated point, or two within a millisecond, would have jobs writing the same file at once
+        auto name = file.getFileName() + "_" + juce::String(pos / sampleRate, 3) + "s.wav";
+        if (! outputNames.insert(name).second)
+        {
+            std::cerr << "skipping duplicate point " << name << std::endl;
+            return;
+        }
+
+        auto snapshot = std::make_unique<Snapshot>();
+        snapshot->output = outputDir.getChildFile(name);
+        snapshot->audio.setSize(numChannels, snapshotLength);
+        snapshot->audio.clear();
+        snapshot->sampleRate = sampleRate;
+        snapshot->preroll = preroll;
+
+        // right-aligned, so a point near the start has silence before it
+        for (int channel = 0; channel < numChannels; ++channel)
+            FreezeKernels::copyFromRing(snapshot->audio.getWritePointer(channel, preroll - historyFilled),
+                                        history.getReadPointer(channel), preroll,
+                                        (historyIndex - historyFilled + preroll) % preroll, historyFilled);
+        snapshot->filled = preroll;
+        active.push_back(std::move(snapshot));
+        ++numSnapshots;
+    };
+
+    for (juce::int64 pos = 0; pos < length; )
+    {
+        // stop each chunk at the next point so snapshots start on the exact sample
+        juce::int64 numToRead = juce::jmin(static_cast<juce::int64>(renderBlock), length - pos);
+        if (nextPoint < pointSamples.size() && pointSamples[nextPoint] > pos)
+            numToRead = juce::jmin(numToRead, pointSamples[nextPoint] - pos);
+        int numSamples = static_cast<int>(numToRead);
+
+        if (! reader.read(&chunk, 0, numSamples, pos, true, true))
+        {
+            std::cerr << "read error in " << file.getFullPathName() << std::endl;
+            break;
+        }
+
+        while (nextPoint < pointSamples.size() && pointSamples[nextPoint] <= pos)
+            if (pointSamples[nextPoint++] == pos)
+                startSnapshot(pos);
+
+        if (detectOnsets && detector.isOnset(chunk, numSamples))
+            startSnapshot(pos);
+
+        for (auto& snapshot : active)
+        {
+            int copied = juce::jmin(numSamples, snapshot->audio.getNumSamples() - snapshot->filled);
+            for (int channel = 0; channel < numChannels; ++channel)
+                snapshot->audio.copyFrom(channel, snapshot->filled, chunk, channel, 0, copied);
+            snapshot->filled += copied;
+        }
+
+        // full snapshots go to the render jobs, waiting here if they are all busy
+        for (auto it = active.begin(); it != active.end(); )
+        {
+            if ((*it)->filled == snapshotLength)
+            {
+                queue.push(std::move(*it));
+                it = active.erase(it);
+            }
+            else
+                ++it;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+            FreezeKernels::copyToRing(history.getWritePointer(channel), preroll, historyIndex,
+                                      chunk.getReadPointer(channel), numSamples);
+        historyIndex = FreezeKernels::wrap(historyIndex, numSamples, preroll);
+        historyFilled = juce::jmin(preroll, historyFilled + numSamples);
+        pos += numSamples;
+    }
+
+    // points near the end get silence after the file runs out
+    for (auto& snapshot : active)
+        queue.push(std::move(snapshot));
+
+    if (nextPoint < pointSamples.size())
+        std::cerr << (pointSamples.size() - nextPoint) << " points past the end of " << file.getFileName() << std::endl;
+
+    return numSnapshots;
+}
+
+//==============================================================================
+// "<file> <seconds>" per line, grouped by file
+static bool parsePoints(const juce::File& pointsFile, std::map<juce::String, std::vector<double>>& points)
+{
+    juce::StringArray lines;
+    pointsFile.readLines(lines);
+
+    for (auto& rawLine : lines)
+    {
+        auto line = rawLine.trim();
+        if (line.isEmpty() || line.startsWithChar('#')) continue;
+
+        // the file name may itself contain spaces, the time is the last word
+        auto name = line.upToLastOccurrenceOf(" ", false, false).trim();
+        auto time = line.fromLastOccurrenceOf(" ", false, false);
+        if (name.isEmpty() || ! time.containsOnly("0123456789."))
+        {
+            std::cerr << "bad point line: " << line << std::endl;
+            return false;
+        }
+
+        points[name].push_back(time.getDoubleValue());
+    }
+
+    return true;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: AudioFreezeFrameBatch <folder> <points|--onsets> <outdir> [--length ms] [--hold s] [--jobs n] [--threshold dB] [--shared-phase] [--seed n]" << std::endl;
+        return 1;
+    }
+
+    juce::File folder = juce::File::getCurrentWorkingDirectory().getChildFile(argv[1]);
+    juce::String pointsArg(argv[2]);
+    juce::File outputDir = juce::File::getCurrentWorkingDirectory().getChildFile(argv[3]);
+    bool detectOnsets = pointsArg == "--onsets";
+    BatchSettings settings;
+    int numJobs = juce::SystemStats::getNumCpus();
+
+    for (int i = 4; i < argc; ++i)
+    {
+        juce::String arg(argv[i]);
+
+        if (arg == "--length" && i + 1 < argc)         settings.lengthMs = juce::String(argv[++i]).getDoubleValue();
+        else if (arg == "--hold" && i + 1 < argc)      settings.holdSeconds = juce::String(argv[++i]).getDoubleValue();
+        else if (arg == "--jobs" && i + 1 < argc)      numJobs = juce::String(argv[++i]).getIntValue();
+        else if (arg == "--threshold" && i + 1 < argc) settings.thresholdDb = juce::String(argv[++i]).getFloatValue();
+        else if (arg == "--shared-phase")              settings.sharedPhase = true;
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            settings.seeded = true;
+            settings.seed = juce::String(argv[++i]).getLargeIntValue();
+        }
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (numJobs <= 0 || settings.holdSeconds <= 0.0)
+    {
+        std::cerr << "jobs and hold must be positive" << std::endl;
+        return 1;
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    std::map<juce::String, std::vector<double>> points;
+    if (detectOnsets)
+    {
+        for (auto& file : folder.findChildFiles(juce::File::findFiles, false, formatManager.getWildcardForAllFormats()))
+            points[file.getFileName()];
+    }
+    else if (! parsePoints(juce::File::getCurrentWorkingDirectory().getChildFile(pointsArg), points))
+    {
+        return 1;
+    }
+
+    // outputs are named after the file alone, so files of the same name in different folders would collide
+    std::map<juce::String, juce::String> outputStems;
+    for (auto& entry : points)
+    {
+        auto stem = outputStems.emplace(folder.getChildFile(entry.first).getFileName(), entry.first);
+        if (! stem.second)
+        {
+            std::cerr << stem.first->second << " and " << entry.first << " would write the same outputs" << std::endl;
+            return 1;
+        }
+    }
+
+    if (! outputDir.createDirectory())
+    {
+        std::cerr << "can't create " << outputDir.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    // a couple of snapshots waiting per job keeps every core busy without piling up
+    SnapshotQueue queue(2 * numJobs);
+    juce::ThreadPool pool(numJobs);
+    std::vector<std::unique_ptr<RenderJob>> jobs;
+    for (int i = 0; i < numJobs; ++i)
+    {
+        jobs.push_back(std::make_unique<RenderJob>(queue, settings));
+        pool.addJob(jobs.back().get(), false);
+    }
+
+    auto startTime = juce::Time::getHighResolutionTicks();
+    int numFiles = 0;
+    int numSnapshots = 0;
+
+    for (auto& entry : points)
+    {
+        juce::File file = folder.getChildFile(entry.first);
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+        if (reader == nullptr)
+        {
+            std::cerr << "can't read " << file.getFullPathName() << std::endl;
+            continue;
+        }
+
+        numSnapshots += extractSnapshots(*reader, file, outputDir, entry.second, detectOnsets, settings, queue);
+        ++numFiles;
+    }
+
+    queue.finish();
+
+    int numRendered = 0;
+    int numFailed = 0;
+    for (auto& job : jobs)
+    {
+        pool.waitForJobToFinish(job.get(), -1);
+        numRendered += job->getNumRendered();
+        numFailed += job->getNumFailed();
+    }
+
+    double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTime);
+    std::cout << "rendered " << numRendered << " of " << numSnapshots << " freezes from " << numFiles << " files in "
+              << seconds << " s on " << numJobs << " threads" << std::endl;
+    return numFailed == 0 ? 0 : 1;
+}
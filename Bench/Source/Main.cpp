@@ -0,0 +1,772 @@
+/*
+  ==============================================================================
+
+    Timing harness for the freeze engine: runs each hot path over a sweep of
+    block sizes, channel counts and freeze lengths and reports the mean cost
+    per sample and the worst single call, so regressions show up as numbers
+    and deployments can be sized against the callback budget.
+
+    usage: AudioFreezeFrameBench [--quick] [--csv] [--rate hz]
+           AudioFreezeFrameBench --verify [--baseline csv] [--save-baseline csv] [--max-drop %]
+        --quick     fewer repetitions and a reduced sweep
+        --csv       print comma separated values instead of a table
+        --rate hz   sample rate the callback budget is worked out at (default 48000)
+
+    --verify runs sines, noise and a chirp through a seeded freeze and thaw in
+    both loop modes, transformed inline and on the spectral worker, and checks
+    the output instead of sweeping: the loop has no step at its seams, the
+    frozen spectrum matches the one it was taken from, neither the thaw's
+    crossfade nor the worker's loop fading in clicks (and a click added to
+    either is caught), and a repeat renders the same samples. It times the same
+    renders, and with --baseline fails any case whose samples per second fell
+    by more than --max-drop percent (default 10) against a previous
+    --save-baseline. The exit code is non-zero if anything failed.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/FreezeEngine.h"
+#include "../../Source/FreezeKernels.h"
+#include "../../Source/SpectralUtils.h"
+#include "../../Source/SpectralWorker.h"
+
+//==============================================================================
+// endless white noise, so the engine always has something to pull
+struct NoiseSource  : public juce::PositionableAudioSource
+{
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& block) override
+    {
+        for (int channel = 0; channel < block.buffer->getNumChannels(); ++channel)
+        {
+            float* out = block.buffer->getWritePointer(channel, block.startSample);
+            for (int i = 0; i < block.numSamples; ++i)
+                out[i] = random.nextFloat() * 2.0f - 1.0f;
+        }
+        position += block.numSamples;
+    }
+
+    void setNextReadPosition(juce::int64 newPosition) override { position = newPosition; }
+    juce::int64 getNextReadPosition() const override { return position; }
+    juce::int64 getTotalLength() const override { return std::numeric_limits<juce::int64>::max(); }
+    bool isLooping() const override { return false; }
+
+    juce::Random random;
+    juce::int64 position = 0;
+};
+
+// accumulates the duration of repeated calls
+struct Timing
+{
+    void add(juce::int64 ticks)
+    {
+        total += ticks;
+        worst = juce::jmax(worst, ticks);
+        ++calls;
+    }
+
+    double seconds() const { return juce::Time::highResolutionTicksToSeconds(total); }
+    double worstSeconds() const { return juce::Time::highResolutionTicksToSeconds(worst); }
+
+    juce::int64 total = 0;
+    juce::int64 worst = 0;
+    int calls = 0;
+};
+
+template <typename Function>
+static void timeCall(Timing& timing, Function&& function)
+{
+    auto start = juce::Time::getHighResolutionTicks();
+    function();
+    timing.add(juce::Time::getHighResolutionTicks() - start);
+}
+
+//==============================================================================
+struct Settings
+{
+    bool quick = false;
+    bool csv = false;
+    double sampleRate = 48000.0;
+    bool verify = false;
+    juce::File baselineFile;
+    juce::File saveBaselineFile;
+    double maxDropPercent = 10.0;
+};
+
+static void report(const Settings& settings, const char* name, int blockSize, int numChannels,
+                   int freezeSamples, const Timing& timing, juce::int64 samplesPerCall)
+{
+    // ns per channel-sample, and the worst call against the real-time budget of one block
+    double nsPerSample = 1.0e9 * timing.seconds() / (static_cast<double>(timing.calls) * samplesPerCall * numChannels);
+    double worstMicros = 1.0e6 * timing.worstSeconds();
+    double budget = 100.0 * timing.worstSeconds() * settings.sampleRate / blockSize;
+
+    if (settings.csv)
+        std::cout << name << "," << blockSize << "," << numChannels << "," << freezeSamples << ","
+                  << nsPerSample << "," << worstMicros << "," << budget << std::endl;
+    else
+        std::cout << juce::String(name).paddedRight(' ', 22)
+                  << juce::String(blockSize).paddedLeft(' ', 7)
+                  << juce::String(numChannels).paddedLeft(' ', 5)
+                  << juce::String(freezeSamples).paddedLeft(' ', 9)
+                  << juce::String(nsPerSample, 2).paddedLeft(' ', 12)
+                  << juce::String(worstMicros, 1).paddedLeft(' ', 12)
+                  << juce::String(budget, 1).paddedLeft(' ', 10) << std::endl;
+}
+
+//==============================================================================
+// drives a real engine, with the spectral worker on its own thread as in the app,
+// through live -> forecast -> frozen -> thaw and times every process() call
+static void benchEngine(const Settings& settings, int blockSize, int numChannels, int freezeSamples)
+{
+    int repeats = settings.quick ? 2 : 5;
+
+    for (bool prerender : { false, true })
+    {
+        FreezeEngine engine;
+        NoiseSource source;
+        engine.setPrerenderedLoop(prerender);
+        engine.prepare(numChannels, freezeSamples);
+        engine.setSource(&source);
+
+        juce::AudioSampleBuffer buffer(numChannels, blockSize);
+        juce::AudioSourceChannelInfo block(&buffer, 0, blockSize);
+        int halfBlocks = (freezeSamples / 2 + blockSize - 1) / blockSize;
+        int loopBlocks = juce::jmax(64, freezeSamples / blockSize);
+        Timing live, forecast, frozen, thaw;
+
+        for (int repeat = 0; repeat < repeats; ++repeat)
+        {
+            for (int i = 0; i < freezeSamples / blockSize + 1; ++i)
+                timeCall(live, [&] { engine.process(block); });
+
+            engine.freeze();
+            for (int i = 0; i < halfBlocks; ++i)
+                timeCall(forecast, [&] { engine.process(block); });
+
+            // let the worker finish so the frozen timings measure playback, not waiting
+            juce::Thread::sleep(juce::jmax(20, freezeSamples / 1024));
+            for (int i = 0; i < loopBlocks; ++i)
+                timeCall(frozen, [&] { engine.process(block); });
+
+            engine.thaw();
+            for (int i = 0; i < halfBlocks + loopBlocks; ++i)
+                timeCall(thaw, [&] { engine.process(block); });
+        }
+
+        engine.release();
+
+        if (! prerender)
+        {
+            report(settings, "live", blockSize, numChannels, freezeSamples, live, blockSize);
+            report(settings, "forecast", blockSize, numChannels, freezeSamples, forecast, blockSize);
+            report(settings, "frozen (crossfade)", blockSize, numChannels, freezeSamples, frozen, blockSize);
+            report(settings, "thaw", blockSize, numChannels, freezeSamples, thaw, blockSize);
+        }
+        else
+        {
+            report(settings, "frozen (prerendered)", blockSize, numChannels, freezeSamples, frozen, blockSize);
+        }
+    }
+}
+
+// the block kernels on their own, without the engine's bookkeeping around them
+static void benchKernels(const Settings& settings, int blockSize, int freezeSamples)
+{
+    int calls = settings.quick ? 2000 : 20000;
+    std::vector<float> ring(freezeSamples), window(freezeSamples), complement(freezeSamples), out(blockSize);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), freezeSamples, juce::dsp::WindowingFunction<float>::hann, false);
+    juce::FloatVectorOperations::fill(complement.data(), 1.0f, freezeSamples);
+    juce::FloatVectorOperations::subtract(complement.data(), window.data(), freezeSamples);
+    juce::Random random;
+    for (auto& sample : ring)
+        sample = random.nextFloat();
+
+    Timing readLoop, forecastFade, thawFade, indexMath;
+    int index = 0;
+    int windowIndex = 0;
+
+    for (int i = 0; i < calls; ++i)
+    {
+        timeCall(readLoop, [&] { FreezeKernels::readLoop(out.data(), ring.data(), window.data(), complement.data(),
+                                                         freezeSamples, index, windowIndex, blockSize); });
+        timeCall(forecastFade, [&] { FreezeKernels::forecastFade(out.data(), ring.data(), window.data(), complement.data(),
+                                                                 freezeSamples, index, freezeSamples / 2 + windowIndex % (freezeSamples / 2), blockSize); });
+        timeCall(thawFade, [&] { FreezeKernels::thawFade(out.data(), ring.data(), window.data(), complement.data(),
+                                                         freezeSamples, index, freezeSamples / 2 + windowIndex % (freezeSamples / 2), blockSize); });
+
+        // the per-block index arithmetic that used to run per sample
+        timeCall(indexMath, [&]
+        {
+            for (int n = 0; n < blockSize; ++n)
+                index = FreezeKernels::wrap(index, 1, freezeSamples);
+        });
+
+        windowIndex = FreezeKernels::wrap(windowIndex, blockSize % freezeSamples, freezeSamples);
+    }
+
+    report(settings, "kernel readLoop", blockSize, 1, freezeSamples, readLoop, blockSize);
+    report(settings, "kernel forecastFade", blockSize, 1, freezeSamples, forecastFade, blockSize);
+    report(settings, "kernel thawFade", blockSize, 1, freezeSamples, thawFade, blockSize);
+    report(settings, "ring index wrap", blockSize, 1, freezeSamples, indexMath, blockSize);
+}
+
+// the whole freeze transform: unwrap, forward FFT, phase randomisation, inverse FFT, rewrap
+static void benchTransform(const Settings& settings, int numChannels, int freezeSamples)
+{
+    int calls = settings.quick ? 3 : 10;
+    std::vector<float> window(freezeSamples, 0.5f), complement(freezeSamples, 0.5f);
+    juce::AudioSampleBuffer ring(numChannels, freezeSamples), loop(numChannels, freezeSamples);
+    juce::Random random;
+    for (int channel = 0; channel < numChannels; ++channel)
+        for (int i = 0; i < freezeSamples; ++i)
+            ring.setSample(channel, i, random.nextFloat());
+
+    for (bool withLoop : { false, true })
+    {
+        SpectralWorker worker;
+        worker.prepare(numChannels, freezeSamples, window.data(), complement.data(), false);
+        Timing timing;
+
+        for (int i = 0; i < calls; ++i)
+        {
+            timeCall(timing, [&] { worker.postSnapshot(ring, freezeSamples / 3, withLoop); });
+            worker.collectResult(ring, loop);
+        }
+
+        report(settings, withLoop ? "transform + loop" : "transform", freezeSamples, numChannels, freezeSamples,
+               timing, freezeSamples);
+    }
+}
+
+//==============================================================================
+enum class Signal
+{
+    Sines,
+    Noise,
+    Chirp
+};
+
+static const char* getSignalName(Signal signal)
+{
+    switch (signal)
+    {
+        case Signal::Sines: return "sines";
+        case Signal::Noise: return "noise";
+        case Signal::Chirp: return "chirp";
+    }
+    return "";
+}
+
+// each signal is a function of the sample position alone, so what the engine
+// was fed can be regenerated exactly to compare against
+static float getSignalSample(Signal signal, juce::int64 position, double sampleRate)
+{
+    double time = static_cast<double>(position) / sampleRate;
+
+    switch (signal)
+    {
+        case Signal::Sines:
+        {
+            // a chord of six partials, spread over as many bands
+            double sum = 0.0;
+            for (double frequency : { 220.0, 330.0, 550.0, 880.0, 1320.0, 2090.0 })
+                sum += std::sin(juce::MathConstants<double>::twoPi * frequency * time);
+            return static_cast<float>(0.12 * sum);
+        }
+
+        case Signal::Noise:
+        {
+            // a hash of the position rather than a running generator; kept quiet, since a
+            // click only stands out of white noise by being louder than its steps
+            juce::uint64 x = static_cast<juce::uint64>(position) * 0x9e3779b97f4a7c15ull;
+            x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+            x ^= x >> 31;
+            return 0.2f * (static_cast<float>(x >> 40) * (1.0f / 16777216.0f) - 0.5f);
+        }
+
+        case Signal::Chirp:
+        {
+            // exponential sweep from 100 Hz, reaching 8 kHz after 4 s; a verify run reads less than that
+            double rate = std::log(80.0) / 4.0;
+            return static_cast<float>(0.5 * std::sin(juce::MathConstants<double>::twoPi * 100.0 * (std::exp(rate * time) - 1.0) / rate));
+        }
+    }
+    return 0.0f;
+}
+
+struct SignalSource  : public juce::PositionableAudioSource
+{
+    SignalSource(Signal newSignal, double newSampleRate)
+        : signal(newSignal), sampleRate(newSampleRate)
+    {
+    }
+
+    void prepareToPlay(int, double) override {}
+    void releaseResources() override {}
+
+    void getNextAudioBlock(const juce::AudioSourceChannelInfo& block) override
+    {
+        for (int i = 0; i < block.numSamples; ++i)
+        {
+            float sample = getSignalSample(signal, position + i, sampleRate);
+            for (int channel = 0; channel < block.buffer->getNumChannels(); ++channel)
+                block.buffer->setSample(channel, block.startSample + i, sample);
+        }
+        position += block.numSamples;
+    }
+
+    void setNextReadPosition(juce::int64 newPosition) override { position = newPosition; }
+    juce::int64 getNextReadPosition() const override { return position; }
+    juce::int64 getTotalLength() const override { return std::numeric_limits<juce::int64>::max(); }
+    bool isLooping() const override { return false; }
+
+    Signal signal;
+    double sampleRate;
+    juce::int64 position = 0;
+};
+
+//==============================================================================
+// the limits a verify case must stay within
+static constexpr float maxSeamRatio = 1.5f;
+static constexpr float maxSpectrumErrorDb = 4.0f;
+// for both the thaw's crossfade and the worker's loop fading in
+static constexpr float maxFadeRatio = 1.5f;
+
+static constexpr int spectrumOrder = 12;
+static constexpr int spectrumSize = 1 << spectrumOrder;
+
+// mean power spectrum of half-overlapping Hann frames
+static std::vector<double> measurePowerSpectrum(const float* samples, int numSamples)
+{
+    juce::dsp::FFT fft(spectrumOrder);
+    std::vector<float> window(spectrumSize), data(spectrumSize * 2);
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), spectrumSize, juce::dsp::WindowingFunction<float>::hann, false);
+    std::vector<double> powers(SpectralUtils::getNumBins(spectrumSize), 0.0);
+    int frames = 0;
+
+    for (int start = 0; start + spectrumSize <= numSamples; start += spectrumSize / 2, ++frames)
+    {
+        juce::FloatVectorOperations::multiply(data.data(), samples + start, window.data(), spectrumSize);
+        fft.performRealOnlyForwardTransform(data.data());
+        for (size_t bin = 0; bin < powers.size(); ++bin)
+            powers[bin] += data[2 * bin] * data[2 * bin] + data[2 * bin + 1] * data[2 * bin + 1];
+    }
+
+    for (auto& power : powers)
+        power /= juce::jmax(1, frames);
+    return powers;
+}
+
+// the mean difference in third-octave band level, over the bands within 30 dB of the loudest.
+// bands start at 100 Hz, below which a frame has too few bins for a stable level; a single
+// tone's level in a freeze varies by a few dB with its random phases, hence the mean
+static float compareSpectra(const std::vector<double>& reference, const std::vector<double>& measured, double sampleRate)
+{
+    const double thirdOctave = std::pow(2.0, 1.0 / 3.0);
+    double binHz = sampleRate / spectrumSize;
+    std::vector<std::pair<double, double>> bands;
+
+    for (double low = 100.0; low * thirdOctave < sampleRate * 0.45; low *= thirdOctave)
+    {
+        std::pair<double, double> band { 0.0, 0.0 };
+        for (size_t bin = static_cast<size_t>(std::ceil(low / binHz)); bin * binHz < low * thirdOctave; ++bin)
+        {
+            band.first += reference[bin];
+            band.second += measured[bin];
+        }
+        bands.push_back(band);
+    }
+
+    double loudest = 0.0;
+    for (auto& band : bands)
+        loudest = juce::jmax(loudest, band.first);
+
+    double error = 0.0;
+    int compared = 0;
+    for (auto& band : bands)
+    {
+        if (band.first > loudest * 1.0e-3)
+        {
+            error += std::abs(10.0 * std::log10((band.second + 1.0e-20) / band.first));
+            ++compared;
+        }
+    }
+    return static_cast<float>(error / juce::jmax(1, compared));
+}
+
+// the buffer a freeze at freezeAt transforms: the half buffer before it as it was played,
+// then the forecast, which crossfades from the source back to that half buffer
+static std::vector<float> getCapturedSource(const std::vector<float>& dry, juce::int64 freezeAt, int freezeSamples)
+{
+    int half = freezeSamples / 2;
+    std::vector<float> window(static_cast<size_t>(freezeSamples)), captured(static_cast<size_t>(freezeSamples));
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window.data(), freezeSamples, juce::dsp::WindowingFunction<float>::hann, false);
+
+    for (int i = 0; i < half; ++i)
+    {
+        size_t fading = static_cast<size_t>(freezeAt + i);
+        captured[static_cast<size_t>(i)] = dry[fading - static_cast<size_t>(half)];
+        captured[static_cast<size_t>(half + i)] = dry[fading] * window[static_cast<size_t>(half + i)]
+                                                  + dry[fading - static_cast<size_t>(half) + 1] * (1.0f - window[static_cast<size_t>(half + i)]);
+    }
+    return captured;
+}
+
+// the largest second difference in [start, end): a step stands out in it far more than in
+// the signal, while smooth content, however loud, stays small
+static float getLargestStep(const float* samples, juce::int64 start, juce::int64 end)
+{
+    float largest = 0.0f;
+    for (juce::int64 i = juce::jmax<juce::int64>(2, start); i < end; ++i)
+        largest = juce::jmax(largest, std::abs(samples[i] - 2.0f * samples[i - 1] + samples[i - 2]));
+    return largest;
+}
+
+struct VerifyResult
+{
+    float seamRatio = 0.0f;
+    float spectrumError = 0.0f;
+    float thawRatio = 0.0f;
+    // threaded cases only: the worker's loop fading in over the raw ring
+    float handoffRatio = 0.0f;
+    float clickRatio = 0.0f;
+    bool repeatable = true;
+    double samplesPerSecond = 0.0;
+};
+
+// where a render's fades fell: the thaw's crossfade starts at resumeAt, picking the source
+// up at resumeFrom, and a threaded freeze's loop fades in over the raw ring from handoffAt
+struct RenderedFreeze
+{
+    juce::int64 sourceRead = 0;
+    juce::int64 resumeAt = -1;
+    juce::int64 resumeFrom = 0;
+    juce::int64 handoffAt = -1;
+};
+
+// one seeded freeze and thaw, rendered in blocks the way an audio callback drives the engine.
+// a synchronous render transforms inline, as offline renders do; a threaded one hands the
+// freeze to the spectral worker like the app and the plugin, and waits for it before each
+// block after the forecast, so the loop always lands on the first of them
+static RenderedFreeze renderFreeze(Signal signal, bool prerender, bool threaded, double sampleRate, int freezeSamples,
+                                   juce::int64 freezeAt, juce::int64 thawAt, juce::AudioSampleBuffer& output, Timing& timing)
+{
+    const int blockSize = 512;
+
+    FreezeEngine engine;
+    SignalSource source(signal, sampleRate);
+    engine.setPrerenderedLoop(prerender);
+    engine.setPhaseSeed(1);
+    engine.prepare(output.getNumChannels(), freezeSamples, ! threaded);
+    engine.setSource(&source);
+
+    RenderedFreeze rendered;
+    juce::AudioSampleBuffer block(output.getNumChannels(), blockSize);
+    for (int position = 0; position < output.getNumSamples(); position += blockSize)
+    {
+        int numSamples = juce::jmin(blockSize, output.getNumSamples() - position);
+        if (freezeAt >= position && freezeAt < position + numSamples)
+            engine.freeze(static_cast<int>(freezeAt - position));
+        if (thawAt >= position && thawAt < position + numSamples)
+            engine.thaw(static_cast<int>(thawAt - position));
+
+        // a worker that never comes back leaves handoffAt unset, which fails the case
+        bool awaitingLoop = engine.isAwaitingLoop();
+        for (int waited = 0; awaitingLoop && ! engine.isLoopCollectable() && waited < 10000; ++waited)
+            juce::Thread::sleep(1);
+
+        juce::int64 before = source.getNextReadPosition();
+        timeCall(timing, [&] { engine.process(juce::AudioSourceChannelInfo(&block, 0, numSamples)); });
+
+        if (awaitingLoop && ! engine.isAwaitingLoop() && rendered.handoffAt < 0)
+            rendered.handoffAt = position;
+
+        // the source stays paused from the freeze until the thaw's crossfade, which then runs to the end of the block
+        juce::int64 pulled = source.getNextReadPosition() - before;
+        if (rendered.resumeAt < 0 && position + numSamples > thawAt && pulled > 0)
+        {
+            rendered.resumeAt = position + numSamples - pulled;
+            rendered.resumeFrom = before;
+        }
+
+        for (int channel = 0; channel < output.getNumChannels(); ++channel)
+            output.copyFrom(channel, position, block, channel, 0, numSamples);
+    }
+
+    engine.release();
+    rendered.sourceRead = source.getNextReadPosition();
+    return rendered;
+}
+
+static VerifyResult verifyFreeze(const Settings& settings, Signal signal, bool prerender, bool threaded)
+{
+    // one of the app's lengths, which is no power of two, so the loop relies on its crossfade
+    const int freezeSamples = 2 * juce::roundToInt(0.375 * settings.sampleRate);
+    const int numChannels = 2;
+    const int seamWidth = 32;
+
+    // freeze and thaw off the block grid; the loop is fully in half a buffer after the
+    // freeze, and a thaw takes at most a buffer and a half to get back to the source
+    const juce::int64 freezeAt = 2 * freezeSamples + 137;
+    const juce::int64 loopStart = freezeAt + freezeSamples / 2;
+    const juce::int64 thawAt = loopStart + 3 * freezeSamples + 59;
+    const int totalSamples = static_cast<int>(thawAt + 3 * freezeSamples);
+
+    VerifyResult result;
+    juce::AudioSampleBuffer output(numChannels, totalSamples), repeat(numChannels, totalSamples);
+    RenderedFreeze rendered;
+    double fastest = std::numeric_limits<double>::max();
+
+    // every repeat is timed and the fastest kept; each must match the first sample for sample
+    for (int run = 0; run < (settings.quick ? 3 : 10); ++run)
+    {
+        Timing timing;
+        rendered = renderFreeze(signal, prerender, threaded, settings.sampleRate, freezeSamples, freezeAt, thawAt,
+                                run == 0 ? output : repeat, timing);
+        fastest = juce::jmin(fastest, timing.seconds());
+
+        for (int channel = 0; run > 0 && channel < numChannels; ++channel)
+            if (std::memcmp(output.getReadPointer(channel), repeat.getReadPointer(channel), sizeof(float) * static_cast<size_t>(totalSamples)) != 0)
+                result.repeatable = false;
+    }
+    result.samplesPerSecond = totalSamples / juce::jmax(fastest, 1.0e-9);
+
+    // the frozen spectrum is held against the buffer the freeze really took
+    std::vector<float> dry(static_cast<size_t>(rendered.sourceRead));
+    for (size_t i = 0; i < dry.size(); ++i)
+        dry[i] = getSignalSample(signal, static_cast<juce::int64>(i), settings.sampleRate);
+    auto reference = measurePowerSpectrum(getCapturedSource(dry, freezeAt, freezeSamples).data(), freezeSamples);
+
+    // a fade's steps are held against the ones what fades out has on its own just before it, and
+    // those of what fades in. the thaw's crossfade lasts half a buffer and takes the source up from
+    // where it paused; the worker's loop fades in within a quarter, over a raw ring that started with it
+    auto getFadeRatio = [&] (const float* out, juce::int64 fadeAt, int fadeLength, float incomingStep)
+    {
+        float fadeStep = getLargestStep(out, fadeAt - seamWidth, fadeAt + fadeLength + seamWidth);
+        float outgoingStep = getLargestStep(out, juce::jmax(loopStart + seamWidth, fadeAt - freezeSamples / 2), fadeAt - seamWidth);
+        return fadeStep / juce::jmax(juce::jmax(outgoingStep, incomingStep), 1.0e-9f);
+    };
+    const juce::int64 resumeFrom = rendered.resumeFrom;
+    const juce::int64 handoffEnd = rendered.handoffAt + freezeSamples / 4;
+    float resumeStep = getLargestStep(dry.data(), resumeFrom, resumeFrom + freezeSamples / 2 + seamWidth);
+    auto getThawRatio = [&] (const float* out) { return getFadeRatio(out, rendered.resumeAt, freezeSamples / 2, resumeStep); };
+    auto getHandoffRatio = [&] (const float* out)
+    {
+        return getFadeRatio(out, rendered.handoffAt, freezeSamples / 4,
+                            getLargestStep(out, handoffEnd + seamWidth, handoffEnd + freezeSamples / 2));
+    };
+    std::vector<float> clicked(static_cast<size_t>(totalSamples));
+
+    // a threaded case whose loop never came back fails outright
+    if (threaded && rendered.handoffAt < 0)
+        result.handoffRatio = std::numeric_limits<float>::max();
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const float* out = output.getReadPointer(channel);
+
+        // a step at the seams, every half buffer into the loop, against the largest step between
+        // them; the handover from the forecast into the loop is left out of both
+        float seamStep = 0.0f;
+        float loopStep = 0.0f;
+        juce::int64 from = loopStart + seamWidth;
+        for (juce::int64 seam = loopStart + freezeSamples / 2; seam + seamWidth < thawAt; seam += freezeSamples / 2)
+        {
+            loopStep = juce::jmax(loopStep, getLargestStep(out, from, seam - seamWidth));
+            seamStep = juce::jmax(seamStep, getLargestStep(out, seam - seamWidth, seam + seamWidth));
+            from = seam + seamWidth;
+        }
+        loopStep = juce::jmax(loopStep, getLargestStep(out, from, thawAt));
+        result.seamRatio = juce::jmax(result.seamRatio, seamStep / juce::jmax(loopStep, 1.0e-9f));
+
+        auto frozen = measurePowerSpectrum(out + loopStart, static_cast<int>(thawAt - loopStart));
+        result.spectrumError = juce::jmax(result.spectrumError, compareSpectra(reference, frozen, settings.sampleRate));
+
+        // the same measures must catch a click, a lone sample at half of full scale, in each fade
+        std::copy(out, out + totalSamples, clicked.begin());
+        clicked[static_cast<size_t>(rendered.resumeAt + freezeSamples / 4)] += 0.5f;
+        result.thawRatio = juce::jmax(result.thawRatio, getThawRatio(out));
+        float clickRatio = getThawRatio(clicked.data());
+
+        if (threaded && rendered.handoffAt >= 0)
+        {
+            clicked[static_cast<size_t>(rendered.handoffAt + seamWidth)] += 0.5f;
+            result.handoffRatio = juce::jmax(result.handoffRatio, getHandoffRatio(out));
+            clickRatio = juce::jmin(clickRatio, getHandoffRatio(clicked.data()));
+        }
+        result.clickRatio = channel == 0 ? clickRatio : juce::jmin(result.clickRatio, clickRatio);
+    }
+
+    return result;
+}
+
+// "<case>,<samples per second>" per line, as --save-baseline writes it
+static std::map<juce::String, double> readBaseline(const juce::File& file)
+{
+    std::map<juce::String, double> baseline;
+    juce::StringArray lines;
+    file.readLines(lines);
+
+    for (auto& line : lines)
+    {
+        auto tokens = juce::StringArray::fromTokens(line, ",", "");
+        if (tokens.size() == 2 && tokens[1].getDoubleValue() > 0.0)
+            baseline[tokens[0].trim()] = tokens[1].getDoubleValue();
+    }
+    return baseline;
+}
+
+static int runVerification(const Settings& settings)
+{
+    std::map<juce::String, double> baseline;
+    if (settings.baselineFile != juce::File())
+    {
+        if (! settings.baselineFile.existsAsFile())
+        {
+            std::cerr << "can't read " << settings.baselineFile.getFullPathName() << std::endl;
+            return 1;
+        }
+        baseline = readBaseline(settings.baselineFile);
+    }
+
+    if (settings.csv)
+        std::cout << "case,seamRatio,spectrumErrorDb,thawRatio,handoffRatio,clickRatio,repeatable,samplesPerSecond,baselineChangePercent,pass" << std::endl;
+    else
+        std::cout << "case                           seam  spectrum dB   thaw  handoff  click  repeat     samples/s  vs base" << std::endl;
+
+    juce::String savedBaseline;
+    bool allPassed = true;
+
+    for (Signal signal : { Signal::Sines, Signal::Noise, Signal::Chirp })
+    {
+        for (int variant = 0; variant < 4; ++variant)
+        {
+            bool prerender = (variant & 1) != 0;
+            bool threaded = (variant & 2) != 0;
+            juce::String name = juce::String(getSignalName(signal)) + (prerender ? " prerendered" : " crossfade")
+                                + (threaded ? " threaded" : "");
+            VerifyResult result = verifyFreeze(settings, signal, prerender, threaded);
+
+            // a case missing from the baseline is only timed
+            double change = 0.0;
+            auto stored = baseline.find(name);
+            if (stored != baseline.end())
+                change = 100.0 * (result.samplesPerSecond / stored->second - 1.0);
+
+            bool pass = result.seamRatio <= maxSeamRatio
+                        && result.spectrumError <= maxSpectrumErrorDb
+                        && result.thawRatio <= maxFadeRatio
+                        && result.handoffRatio <= maxFadeRatio
+                        && result.clickRatio > maxFadeRatio
+                        && result.repeatable
+                        && change >= -settings.maxDropPercent;
+            allPassed = allPassed && pass;
+            savedBaseline << name << "," << juce::String(result.samplesPerSecond, 0) << "\n";
+
+            juce::String changeText = stored != baseline.end() ? juce::String(change, 1) + "%" : juce::String("-");
+            juce::String handoffText = threaded ? juce::String(result.handoffRatio, 2) : juce::String("-");
+            if (settings.csv)
+                std::cout << name << "," << result.seamRatio << "," << result.spectrumError << "," << result.thawRatio << ","
+                          << (threaded ? juce::String(result.handoffRatio) : juce::String()) << "," << result.clickRatio << ","
+                          << (result.repeatable ? 1 : 0) << "," << juce::String(result.samplesPerSecond, 0) << ","
+                          << (stored != baseline.end() ? juce::String(change, 1) : juce::String()) << "," << (pass ? 1 : 0) << std::endl;
+            else
+                std::cout << name.paddedRight(' ', 28)
+                          << juce::String(result.seamRatio, 2).paddedLeft(' ', 7)
+                          << juce::String(result.spectrumError, 2).paddedLeft(' ', 13)
+                          << juce::String(result.thawRatio, 2).paddedLeft(' ', 7)
+                          << handoffText.paddedLeft(' ', 9)
+                          << juce::String(result.clickRatio, 2).paddedLeft(' ', 7)
+                          << juce::String(result.repeatable ? "yes" : "no").paddedLeft(' ', 8)
+                          << juce::String(result.samplesPerSecond, 0).paddedLeft(' ', 14)
+                          << changeText.paddedLeft(' ', 9)
+                          << (pass ? "" : "  FAIL") << std::endl;
+        }
+    }
+
+    if (settings.saveBaselineFile != juce::File() && ! settings.saveBaselineFile.replaceWithText(savedBaseline))
+    {
+        std::cerr << "can't write " << settings.saveBaselineFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    if (! settings.csv)
+        std::cout << (allPassed ? "all cases passed" : "some cases failed") << " (limits: seam " << maxSeamRatio
+                  << ", spectrum " << maxSpectrumErrorDb << " dB, fades " << maxFadeRatio
+                  << ", throughput -" << settings.maxDropPercent << "%)" << std::endl;
+    return allPassed ? 0 : 1;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    Settings settings;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        juce::String arg(argv[i]);
+
+        if (arg == "--quick")                     settings.quick = true;
+        else if (arg == "--csv")                  settings.csv = true;
+        else if (arg == "--rate" && i + 1 < argc) settings.sampleRate = juce::String(argv[++i]).getDoubleValue();
+        else if (arg == "--verify")               settings.verify = true;
+        else if (arg == "--baseline" && i + 1 < argc)      settings.baselineFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (arg == "--save-baseline" && i + 1 < argc) settings.saveBaselineFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (arg == "--max-drop" && i + 1 < argc)      settings.maxDropPercent = juce::String(argv[++i]).getDoubleValue();
+        else
+        {
+            std::cerr << "usage: AudioFreezeFrameBench [--quick] [--csv] [--rate hz]" << std::endl
+                      << "       AudioFreezeFrameBench --verify [--baseline csv] [--save-baseline csv] [--max-drop %]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (settings.verify)
+        return runVerification(settings);
+
+    // transform rows are one call per freeze, so their "block" is the freeze length
+    if (settings.csv)
+        std::cout << "name,block,channels,freezeSamples,nsPerSample,worstMicros,worstBudgetPercent" << std::endl;
+    else
+        std::cout << "name                    block   ch   freeze   ns/sample    worst us  budget %" << std::endl;
+
+    const int defaultBlock = 512;
+    const int defaultChannels = 2;
+    const int defaultFreeze = 32768;
+    std::vector<int> blockSizes { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    std::vector<int> channelCounts { 1, 2, 4, 8, 16 };
+    std::vector<int> freezeSizes { 4096, 8192, 16384, 32768, 65536, 131072, 262144 };
+
+    if (settings.quick)
+    {
+        blockSizes = { 32, 512, 4096 };
+        channelCounts = { 1, 2, 16 };
+        freezeSizes = { 4096, 32768, 262144 };
+    }
+
+    // each dimension is swept with the other two held at the app's defaults
+    for (int blockSize : blockSizes)
+        benchEngine(settings, blockSize, defaultChannels, defaultFreeze);
+    for (int numChannels : channelCounts)
+        if (numChannels != defaultChannels)
+            benchEngine(settings, defaultBlock, numChannels, defaultFreeze);
+    for (int freezeSamples : freezeSizes)
+        if (freezeSamples != defaultFreeze)
+            benchEngine(settings, defaultBlock, defaultChannels, freezeSamples);
+
+    for (int blockSize : blockSizes)
+        benchKernels(settings, blockSize, defaultFreeze);
+
+    for (int freezeSamples : freezeSizes)
+        benchTransform(settings, defaultChannels, freezeSamples);
+    for (int numChannels : channelCounts)
+        if (numChannels != defaultChannels)
+            benchTransform(settings, numChannels, defaultFreeze);
+
+    return 0;
+}
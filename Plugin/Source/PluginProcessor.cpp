@@ -0,0 +1,187 @@
+#include "PluginProcessor.h"
+
+//==============================================================================
+AudioFreezeFrameProcessor::AudioFreezeFrameProcessor()
+    : AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo(), true)
+                                      .withOutput("Output", juce::AudioChannelSet::stereo(), true)),
+      currentSampleRate(0.0),
+      preparedLength(-1),
+      parameterHeld(false),
+      notesHeld(0),
+      engineFrozen(false),
+      delayIndex(0)
+{
+    juce::StringArray lengthNames;
+    for (int milliseconds : lengthMilliseconds)
+        lengthNames.add(juce::String(milliseconds / 1000.0, 2) + " s");
+
+    addParameter(freezeParameter = new juce::AudioParameterBool("freeze", "Freeze", false));
+    addParameter(lengthParameter = new juce::AudioParameterChoice("length", "Freeze length", lengthNames, defaultLength));
+
+    // the host's buffer is frozen in place, there is no source to pull from
+    engine.setLiveInput(true);
+}
+
+AudioFreezeFrameProcessor::~AudioFreezeFrameProcessor()
+{
+    cancelPendingUpdate();
+}
+
+//==============================================================================
+void AudioFreezeFrameProcessor::prepareToPlay(double sampleRate, int samplesPerBlock)
+{
+    juce::ignoreUnused(samplesPerBlock);
+
+    currentSampleRate = sampleRate;
+    int length = lengthParameter->getIndex();
+
+    // an offline bounce transforms on the audio thread, so every freeze lands where it would live
+    engine.prepare(getTotalNumOutputChannels(), getFreezeSamples(length), isNonRealtime());
+    prepareDelay(engine.getFreezeSamples() / 2);
+    preparedLength = length;
+    parameterHeld = false;
+    notesHeld = 0;
+    engineFrozen = false;
+    setLatencySamples(engine.getFreezeSamples() / 2);
+}
+
+void AudioFreezeFrameProcessor::releaseResources()
+{
+    engine.release();
+}
+
+bool AudioFreezeFrameProcessor::isBusesLayoutSupported(const BusesLayout& layouts) const
+{
+    // the engine takes any number of channels, as long as each output has its input
+    return ! layouts.getMainOutputChannelSet().isDisabled()
+           && layouts.getMainInputChannelSet() == layouts.getMainOutputChannelSet();
+}
+
+void AudioFreezeFrameProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ScopedNoDenormals noDenormals;
+    int numInputs = getTotalNumInputChannels();
+    int numOutputs = getTotalNumOutputChannels();
+
+    for (int channel = numInputs; channel < numOutputs; ++channel)
+        buffer.clear(channel, 0, buffer.getNumSamples());
+
+    if (lengthParameter->getIndex() != preparedLength.load())
+        triggerAsyncUpdate();
+
+    delayInput(buffer, numOutputs);
+
+    // automation only arrives once per block, so the parameter lands on the block's first sample;
+    // a command that didn't fit in the queue is retried here on the next block
+    parameterHeld = freezeParameter->get();
+    updateFreeze(0);
+
+    for (const auto metadata : midiMessages)
+    {
+        auto message = metadata.getMessage();
+        if (message.isNoteOn())
+            ++notesHeld;
+        else if (message.isNoteOff())
+            notesHeld = juce::jmax(0, notesHeld - 1);
+        else if (message.isAllNotesOff() || message.isAllSoundOff())
+            notesHeld = 0;
+        else
+            continue;
+
+        updateFreeze(metadata.samplePosition);
+    }
+
+    engine.process(juce::AudioSourceChannelInfo(&buffer, 0, buffer.getNumSamples()));
+}
+
+//==============================================================================
+juce::AudioProcessorEditor* AudioFreezeFrameProcessor::createEditor()
+{
+    return new juce::GenericAudioProcessorEditor(*this);
+}
+
+//==============================================================================
+void AudioFreezeFrameProcessor::getStateInformation(juce::MemoryBlock& destData)
+{
+    // the length is kept in milliseconds so the choices can change; a freeze is
+    // a performance, it is never restored
+    juce::XmlElement state("AudioFreezeFrame");
+    state.setAttribute("length", lengthMilliseconds[lengthParameter->getIndex()]);
+    copyXmlToBinary(state, destData);
+}
+
+void AudioFreezeFrameProcessor::setStateInformation(const void* data, int sizeInBytes)
+{
+    std::unique_ptr<juce::XmlElement> state(getXmlFromBinary(data, sizeInBytes));
+    if (state == nullptr || ! state->hasTagName("AudioFreezeFrame")) return;
+
+    int milliseconds = state->getIntAttribute("length", lengthMilliseconds[defaultLength]);
+    for (int i = 0; i < juce::numElementsInArray(lengthMilliseconds); ++i)
+        if (lengthMilliseconds[i] == milliseconds)
+            *lengthParameter = i;
+
+    triggerAsyncUpdate();
+}
+
+//==============================================================================
+int AudioFreezeFrameProcessor::getFreezeSamples(int lengthIndex) const
+{
+    return juce::roundToInt(lengthMilliseconds[lengthIndex] * currentSampleRate / 1000.0);
+}
+
+void AudioFreezeFrameProcessor::prepareDelay(int delaySamples)
+{
+    delayBuffer.setSize(getTotalNumOutputChannels(), delaySamples);
+    delayBuffer.clear();
+    delayIndex = 0;
+}
+
+void AudioFreezeFrameProcessor::delayInput(juce::AudioBuffer<float>& buffer, int numChannels)
+{
+    int numSamples = buffer.getNumSamples();
+    int delaySamples = delayBuffer.getNumSamples();
+
+    // swapping with the delay line leaves the oldest input in the block and the newest in the line
+    for (int done = 0; done < numSamples;)
+    {
+        int span = juce::jmin(numSamples - done, delaySamples - delayIndex);
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* io = buffer.getWritePointer(channel, done);
+            std::swap_ranges(io, io + span, delayBuffer.getWritePointer(channel, delayIndex));
+        }
+
+        delayIndex = (delayIndex + span) % delaySamples;
+        done += span;
+    }
+}
+
+void AudioFreezeFrameProcessor::updateFreeze(int sampleOffset)
+{
+    bool wanted = parameterHeld || notesHeld > 0;
+    if (wanted != engineFrozen && (wanted ? engine.freeze(sampleOffset) : engine.thaw(sampleOffset)))
+        engineFrozen = wanted;
+}
+
+void AudioFreezeFrameProcessor::handleAsyncUpdate()
+{
+    int length = lengthParameter->getIndex();
+    if (currentSampleRate <= 0.0 || length == preparedLength.load()) return;
+
+    // the ring, the loop and the delay are all resized, so keep the audio thread out
+    // until they are; whatever was frozen is gone after the switch
+    suspendProcessing(true);
+    engine.setFreezeLength(getFreezeSamples(length));
+    prepareDelay(engine.getFreezeSamples() / 2);
+    engineFrozen = false;
+    preparedLength = length;
+    suspendProcessing(false);
+
+    setLatencySamples(engine.getFreezeSamples() / 2);
+}
+
+//==============================================================================
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
+{
+    return new AudioFreezeFrameProcessor();
+}
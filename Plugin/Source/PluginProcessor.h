@@ -0,0 +1,94 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include "../../Source/FreezeEngine.h"
+
+//==============================================================================
+/*
+    The freeze engine as a plugin, freezing whatever the host feeds it.
+
+    The engine runs in live input mode on the host's buffer. A freeze forecasts
+    half a buffer before the loop takes over, so the input is delayed by that
+    much and the host is told it is the latency: with the delay compensated, the
+    loop is fully in at the moment the freeze was automated or played, and holds
+    the half buffer leading up to it. The "Freeze" parameter and MIDI notes both
+    freeze and thaw; notes land on their exact sample within the block.
+
+    Instances stay cheap to stack. FFT plans and their scratch, window tables
+    and the helper threads all come from the process-wide SpectralCache, and an
+    instance that isn't freezing holds none of the FFT memory. What is left is
+    sized to the freeze length: the ring, the worker's copy of it and the
+    transform's result, the last freeze's magnitudes and the delay. The plugin
+    never prerenders, recalls or morphs, so the engine never allocates the
+    storage for those, and the worker thread sleeps until a freeze is posted.
+*/
+class AudioFreezeFrameProcessor  : public juce::AudioProcessor,
+                                   private juce::AsyncUpdater
+{
+public:
+    //==============================================================================
+    AudioFreezeFrameProcessor();
+    ~AudioFreezeFrameProcessor() override;
+
+    //==============================================================================
+    void prepareToPlay (double sampleRate, int samplesPerBlock) override;
+    void releaseResources() override;
+    bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
+    void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages) override;
+    using juce::AudioProcessor::processBlock;
+
+    //==============================================================================
+    juce::AudioProcessorEditor* createEditor() override;
+    bool hasEditor() const override { return true; }
+
+    //==============================================================================
+    const juce::String getName() const override { return JucePlugin_Name; }
+    bool acceptsMidi() const override { return true; }
+    bool producesMidi() const override { return false; }
+    bool isMidiEffect() const override { return false; }
+    double getTailLengthSeconds() const override { return 0.0; }
+
+    //==============================================================================
+    int getNumPrograms() override { return 1; }
+    int getCurrentProgram() override { return 0; }
+    void setCurrentProgram (int) override {}
+    const juce::String getProgramName (int) override { return {}; }
+    void changeProgramName (int, const juce::String&) override {}
+
+    //==============================================================================
+    void getStateInformation (juce::MemoryBlock& destData) override;
+    void setStateInformation (const void* data, int sizeInBytes) override;
+
+private:
+    // the freeze length choices, the same ones the app offers
+    static constexpr int lengthMilliseconds[] = { 250, 500, 750, 1000, 2000, 4000 };
+    static constexpr int defaultLength = 3;
+
+    int getFreezeSamples (int lengthIndex) const;
+    void prepareDelay (int delaySamples);
+    void delayInput (juce::AudioBuffer<float>& buffer, int numChannels);
+    void updateFreeze(int sampleOffset);
+    void handleAsyncUpdate() override;
+
+    FreezeEngine engine;
+    juce::AudioParameterBool* freezeParameter;
+    juce::AudioParameterChoice* lengthParameter;
+
+    double currentSampleRate;
+    // the length the engine was last prepared at; a new choice is picked up by
+    // the message thread, which re-prepares with processing suspended
+    std::atomic<int> preparedLength;
+
+    // the engine stays frozen while the parameter is on or any note is held, and is
+    // only told when that changes: a second freeze would restart it mid-loop
+    bool parameterHeld;
+    int notesHeld;
+    bool engineFrozen;
+
+    // the input, delayed by the forecast so the host can line the freeze up
+    juce::AudioSampleBuffer delayBuffer;
+    int delayIndex;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioFreezeFrameProcessor)
+};
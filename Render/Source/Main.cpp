@@ -0,0 +1,265 @@
+/*
+  ==============================================================================
+
+    Offline renderer: runs a file through the FreezeEngine following a script
+    of freeze/thaw events and writes the result, as fast as the CPU allows.
+
+    usage: AudioFreezeFrameRender <input> <events> <output.wav> [options]
+        --block <n>     samples per process() call (default 512)
+        --size <n>      freeze length in samples, any length from 1024 (default 32768)
+        --length <ms>   freeze length in milliseconds at the input's sample rate
+        --prerender     play frozen loops from a prerendered cycle
+        --instant       freeze instantly from the rolling analysis
+        --stft <f> <h>  streaming STFT freeze with frame size f and hop h
+        --layer         with --stft, stack each freeze over the live signal;
+                        thaw fades all layers out
+        --shared-phase  one random phase field for all channels, keeping a
+                        multichannel image coherent
+        --seed <n>      draw the random phases from seed n, so the same
+                        input and events always render the same output
+        --stats <csv>   write histograms of the time each block took, the
+                        freeze transforms and the freeze latency
+
+    The events file has one event per line, "<seconds> freeze|thaw|end", with
+    times on the output timeline (as if the buttons were pressed live). Each
+    lands on its exact sample, whatever the block size.
+    Blank lines and lines starting with '#' are ignored.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../Source/FreezeEngine.h"
+
+//==============================================================================
+struct RenderEvent
+{
+    enum Type
+    {
+        Freeze,
+        Thaw,
+        End
+    };
+
+    juce::int64 samplePos;
+    Type type;
+};
+
+static bool parseEvents(const juce::File& file, double sampleRate, std::vector<RenderEvent>& events)
+{
+    juce::StringArray lines;
+    file.readLines(lines);
+
+    for (auto& rawLine : lines)
+    {
+        auto line = rawLine.trim();
+        if (line.isEmpty() || line.startsWithChar('#')) continue;
+
+        auto tokens = juce::StringArray::fromTokens(line, true);
+        if (tokens.size() != 2)
+        {
+            std::cerr << "bad event line: " << line << std::endl;
+            return false;
+        }
+
+        RenderEvent event;
+        event.samplePos = static_cast<juce::int64>(tokens[0].getDoubleValue() * sampleRate);
+
+        if (tokens[1] == "freeze")    event.type = RenderEvent::Freeze;
+        else if (tokens[1] == "thaw") event.type = RenderEvent::Thaw;
+        else if (tokens[1] == "end")  event.type = RenderEvent::End;
+        else
+        {
+            std::cerr << "unknown event: " << tokens[1] << std::endl;
+            return false;
+        }
+
+        events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(),
+                     [] (const RenderEvent& a, const RenderEvent& b) { return a.samplePos < b.samplePos; });
+    return true;
+}
+
+//==============================================================================
+int main (int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "usage: AudioFreezeFrameRender <input> <events> <output.wav> [--block n] [--size n] [--length ms] [--prerender] [--instant] [--stft f h] [--layer] [--shared-phase] [--seed n] [--stats csv]" << std::endl;
+        return 1;
+    }
+
+    juce::File inputFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[1]);
+    juce::File eventsFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[2]);
+    juce::File outputFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[3]);
+    int blockSize = 512;
+    int freezeSamples = 32768;
+    double lengthMs = 0.0;
+    bool prerender = false;
+    bool instant = false;
+    bool layer = false;
+    bool sharedPhase = false;
+    bool seeded = false;
+    juce::int64 seed = 0;
+    int stftFrame = 0;
+    int stftHop = 0;
+    juce::File statsFile;
+
+    for (int i = 4; i < argc; ++i)
+    {
+        juce::String arg(argv[i]);
+
+        if (arg == "--block" && i + 1 < argc)     blockSize = juce::String(argv[++i]).getIntValue();
+        else if (arg == "--size" && i + 1 < argc) freezeSamples = juce::String(argv[++i]).getIntValue();
+        else if (arg == "--length" && i + 1 < argc) lengthMs = juce::String(argv[++i]).getDoubleValue();
+        else if (arg == "--prerender")            prerender = true;
+        else if (arg == "--instant")              instant = true;
+        else if (arg == "--layer")                layer = true;
+        else if (arg == "--shared-phase")         sharedPhase = true;
+        else if (arg == "--seed" && i + 1 < argc) { seeded = true; seed = juce::String(argv[++i]).getLargeIntValue(); }
+        else if (arg == "--stats" && i + 1 < argc) statsFile = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+        else if (arg == "--stft" && i + 2 < argc)
+        {
+            stftFrame = juce::String(argv[++i]).getIntValue();
+            stftHop = juce::String(argv[++i]).getIntValue();
+        }
+        else
+        {
+            std::cerr << "unknown option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (blockSize <= 0)
+    {
+        std::cerr << "blockSize must be positive" << std::endl;
+        return 1;
+    }
+
+    if (stftFrame != 0 && (! juce::isPowerOfTwo(stftFrame) || stftHop <= 0 || stftFrame % stftHop != 0))
+    {
+        std::cerr << "the STFT frame must be a power of two and a multiple of the hop" << std::endl;
+        return 1;
+    }
+
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    juce::AudioFormatReader* reader = formatManager.createReaderFor(inputFile);
+    if (reader == nullptr)
+    {
+        std::cerr << "can't read " << inputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    double sampleRate = reader->sampleRate;
+    int numChannels = static_cast<int>(reader->numChannels);
+    juce::int64 sourceLength = reader->lengthInSamples;
+    juce::AudioFormatReaderSource source(reader, true);
+
+    if (lengthMs > 0.0)
+        freezeSamples = juce::roundToInt(lengthMs * sampleRate / 1000.0);
+
+    if (freezeSamples < 1024)
+    {
+        std::cerr << "the freeze length must be at least 1024 samples" << std::endl;
+        return 1;
+    }
+
+    std::vector<RenderEvent> events;
+    if (! parseEvents(eventsFile, sampleRate, events)) return 1;
+
+    outputFile.deleteFile();
+    juce::WavAudioFormat wavFormat;
+    std::unique_ptr<juce::AudioFormatWriter> writer(wavFormat.createWriterFor(new juce::FileOutputStream(outputFile),
+                                                                              sampleRate,
+                                                                              static_cast<unsigned int>(numChannels),
+                                                                              24, {}, 0));
+    if (writer == nullptr)
+    {
+        std::cerr << "can't write " << outputFile.getFullPathName() << std::endl;
+        return 1;
+    }
+
+    // deadlines are the real-time ones, so misses show where this would glitch live
+    Telemetry telemetry;
+    telemetry.prepare(sampleRate, false);
+
+    FreezeEngine engine;
+    engine.setTelemetry(&telemetry);
+    engine.setPrerenderedLoop(prerender);
+    engine.setInstantFreeze(instant);
+    engine.setSharedPhase(sharedPhase);
+    if (seeded)
+        engine.setPhaseSeed(static_cast<juce::uint64>(seed));
+    if (stftFrame != 0)
+    {
+        engine.setStftSettings(stftFrame, stftHop, juce::dsp::WindowingFunction<float>::hann);
+        engine.setFreezeMode(FreezeEngine::StftMode);
+        engine.setLayering(layer);
+    }
+    engine.prepare(numChannels, freezeSamples, true);
+    engine.setSource(&source);
+    source.prepareToPlay(blockSize, sampleRate);
+
+    juce::AudioSampleBuffer block(numChannels, blockSize);
+    juce::int64 rendered = 0;
+    juce::int64 frozenSince = 0;
+    size_t nextEvent = 0;
+    bool finished = false;
+    int blockLength = blockSize;
+    double processSeconds = 0.0;
+
+    while (! finished)
+    {
+        // events land on their exact sample within the block they fall in; none past the end is sent,
+        // or a thaw after it would still change the last samples rendered
+        while (! finished && nextEvent < events.size() && events[nextEvent].samplePos < rendered + blockSize)
+        {
+            int offset = static_cast<int>(juce::jmax(static_cast<juce::int64>(0), events[nextEvent].samplePos - rendered));
+
+            switch (events[nextEvent].type)
+            {
+                case RenderEvent::Freeze: engine.freeze(offset); frozenSince = rendered + offset; break;
+                case RenderEvent::Thaw:   engine.thaw(offset); break;
+                case RenderEvent::End:    finished = true; blockLength = offset; break;
+            }
+            ++nextEvent;
+        }
+        if (blockLength == 0) break;
+
+        auto start = juce::Time::getHighResolutionTicks();
+        engine.process(juce::AudioSourceChannelInfo(&block, 0, blockLength));
+        processSeconds += juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+        telemetry.drain();
+
+        writer->writeFromAudioSampleBuffer(block, 0, blockLength);
+        rendered += blockLength;
+        if (finished) break;
+
+        // stop once the source has run out, or one loop after a freeze the script never thaws
+        bool sourceDone = source.getNextReadPosition() >= sourceLength;
+        bool heldForever = engine.isFrozen() && nextEvent == events.size()
+                           && rendered - frozenSince >= 2 * freezeSamples;
+        finished = (sourceDone && ! engine.isFrozen()) || heldForever;
+    }
+
+    source.releaseResources();
+    engine.release();
+    writer.reset();
+
+    std::cout << "rendered " << rendered << " samples x " << numChannels << " channels in "
+              << processSeconds << " s: "
+              << juce::String(rendered / juce::jmax(processSeconds, 1.0e-9), 0) << " samples/s, "
+              << juce::String(rendered / sampleRate / juce::jmax(processSeconds, 1.0e-9), 1) << "x real time"
+              << std::endl;
+
+    if (statsFile != juce::File() && ! telemetry.writeCsv(statsFile))
+    {
+        std::cerr << "can't write " << statsFile.getFullPathName() << std::endl;
+        return 1;
+    }
+    return 0;
+}
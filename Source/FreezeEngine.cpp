@@ -0,0 +1,906 @@
+#include "FreezeEngine.h"
+#include "FreezeKernels.h"
+#include "SpectralUtils.h"
+
+//==============================================================================
+FreezeEngine::FreezeEngine()
+    : commandFifo(commandQueueSize),
+      telemetry(nullptr),
+      freezeRequestedAt(0),
+      preparedChannels(0),
+      preparedSynchronous(false),
+      source(nullptr),
+      liveInput(false),
+      loopPrepared(false),
+      morphPrepared(false),
+      samples(nullptr),
+      complement(nullptr),
+      circularBufferSize(0),
+      currentBufferReadIndex(0),
+      currentBufferWriteIndex(0),
+      forecast(0),
+      frozen(false),
+      thawing(false),
+      justThawed(false),
+      forecasting(false),
+      freezePending(false),
+      snapshotPosted(false),
+      freezeStart(0),
+      prerenderLoop(false),
+      loopRequested(false),
+      loopReady(false),
+      sharedPhase(false),
+      phaseSeed(SpectralUtils::makeRandomSeed()),
+      instantFreeze(false),
+      instantRequested(false),
+      instantFadeSamples(0),
+      instantFadeRemaining(0),
+      handoffFadeRemaining(0),
+      recallPending(nullptr),
+      recallPosted(false),
+      morphState(MorphIdle),
+      morphTarget(nullptr),
+      morphPosted(false),
+      morphHops(0),
+      morphFadeRemaining(0),
+      requestedMode(LoopMode),
+      activeMode(LoopMode),
+      requestedLayering(false),
+      layering(false),
+      stftState(StftLive),
+      stftFadeRemaining(0),
+      stftFrameSize(2048),
+      stftHopSize(512),
+      stftWindow(juce::dsp::WindowingFunction<float>::hann)
+{
+}
+
+FreezeEngine::~FreezeEngine()
+{
+    release();
+}
+
+//==============================================================================
+void FreezeEngine::prepare(int numChannels, int freezeSamples, bool synchronous)
+{
+    // the loop crossfades against its own halfway point, so the length has to be even
+    circularBufferSize = freezeSamples + (freezeSamples & 1);
+    preparedChannels = numChannels;
+    preparedSynchronous = synchronous;
+    circularBuffer.setSize(numChannels, circularBufferSize);
+
+    // the window and its complement come ready made from the cache
+    crossfadeTable = cache->getWindow(circularBufferSize, juce::dsp::WindowingFunction<float>::hann);
+    samples = crossfadeTable->window;
+    complement = crossfadeTable->complement;
+    // each part draws from its own seed so their phases never line up
+    spectralWorker.setPhaseSeed(phaseSeed);
+    stft.setPhaseSeed(phaseSeed + 1);
+    morph.setPhaseSeed(phaseSeed + 2);
+    spectralWorker.prepare(numChannels, circularBufferSize, samples, complement, ! synchronous);
+
+    // a plain freeze loops the ring itself; the loop and morph storage are only
+    // resized if they have been asked for
+    bool wantsLoop = loopPrepared || prerenderLoop || instantFreeze;
+    bool wantsMorph = morphPrepared;
+    loopPrepared = false;
+    morphPrepared = false;
+    if (wantsLoop) prepareLoop();
+    if (wantsMorph) prepareMorph();
+
+    // linear crossfade from the live signal into an instant freeze
+    instantFadeSamples = juce::jmin(1024, circularBufferSize / 4);
+    instantFadeIn.allocate(instantFadeSamples, false);
+    instantFadeOut.allocate(instantFadeSamples, false);
+    for (int i = 0; i < instantFadeSamples; ++i)
+    {
+        instantFadeIn[i] = static_cast<float>(i + 1) / static_cast<float>(instantFadeSamples);
+        instantFadeOut[i] = 1.0f - instantFadeIn[i];
+    }
+    handoffTail.setSize(numChannels, instantFadeSamples);
+    spectralWorker.setRollingAnalysis(instantFreeze);
+
+    // the STFT frame must stay a power of two, so fit the largest one the ring holds
+    int frameSize = juce::jmin(stftFrameSize, juce::nextPowerOfTwo(circularBufferSize + 1) / 2);
+    stft.prepare(numChannels, frameSize, juce::jmin(stftHopSize, frameSize), stftWindow);
+    morph.prepare(numChannels, frameSize, juce::jmin(stftHopSize, frameSize), stftWindow);
+
+    circularBuffer.clear();
+    currentBufferWriteIndex = 0;
+    currentBufferReadIndex = 0;
+    resetState();
+}
+
+void FreezeEngine::setFreezeLength(int freezeSamples)
+{
+    if (preparedChannels == 0) return;
+
+    // process() only try-locks this, so the audio thread drops to silence for
+    // the blocks that land mid-prepare instead of waiting on it
+    const juce::SpinLock::ScopedLockType lock(configLock);
+    prepare(preparedChannels, freezeSamples, preparedSynchronous);
+}
+
+void FreezeEngine::release()
+{
+    spectralWorker.release();
+    freezePending = false;
+}
+
+void FreezeEngine::setSource(juce::PositionableAudioSource* newSource)
+{
+    source = newSource;
+}
+
+//==============================================================================
+void FreezeEngine::setStftSettings(int frameSize, int hopSize,
+                                   juce::dsp::WindowingFunction<float>::WindowingMethod windowType)
+{
+    stftFrameSize = frameSize;
+    stftHopSize = hopSize;
+    stftWindow = windowType;
+}
+
+void FreezeEngine::setSharedPhase(bool shouldShare)
+{
+    sharedPhase = shouldShare;
+    spectralWorker.setSharedPhase(shouldShare);
+}
+
+void FreezeEngine::setPrerenderedLoop(bool shouldPrerender)
+{
+    if (shouldPrerender) prepareLoop();
+    prerenderLoop = shouldPrerender;
+}
+
+void FreezeEngine::setInstantFreeze(bool shouldFreezeInstantly)
+{
+    // the rolling freeze comes back with its loop rendered
+    if (shouldFreezeInstantly) prepareLoop();
+    instantFreeze = shouldFreezeInstantly;
+    spectralWorker.setRollingAnalysis(shouldFreezeInstantly);
+}
+
+bool FreezeEngine::freeze(int sampleOffset)
+{
+    return pushCommand({ FreezeCommand, 0, 0.0f, nullptr, 0, sampleOffset, 0 });
+}
+
+bool FreezeEngine::thaw(int sampleOffset)
+{
+    return pushCommand({ ThawCommand, 0, 0.0f, nullptr, 0, sampleOffset, 0 });
+}
+
+bool FreezeEngine::cancel()
+{
+    return pushCommand({ CancelCommand, 0, 0.0f, nullptr, 0, 0, 0 });
+}
+
+bool FreezeEngine::setLayerGain(int layer, float gain)
+{
+    return pushCommand({ LayerGainCommand, layer, gain, nullptr, 0, 0, 0 });
+}
+
+bool FreezeEngine::recall(const SpectralSnapshot& snapshot)
+{
+    prepareLoop();
+    return pushCommand({ RecallCommand, 0, 0.0f, &snapshot, 0, 0, 0 });
+}
+
+bool FreezeEngine::morphTo(const SpectralSnapshot& snapshot, int morphSamples)
+{
+    prepareLoop();
+    prepareMorph();
+    return pushCommand({ MorphCommand, 0, 0.0f, &snapshot, morphSamples, 0, 0 });
+}
+
+bool FreezeEngine::morphToLive(int morphSamples)
+{
+    return pushCommand({ MorphCommand, 0, 0.0f, nullptr, morphSamples, 0, 0 });
+}
+
+bool FreezeEngine::pushCommand(Command command)
+{
+    int start1, size1, start2, size2;
+    commandFifo.prepareToWrite(1, start1, size1, start2, size2);
+    if (size1 == 0) return false;
+
+    command.time = juce::Time::getHighResolutionTicks();
+    commandQueue[start1] = command;
+    commandFifo.finishedWrite(1);
+    return true;
+}
+
+void FreezeEngine::prepareLoop()
+{
+    if (loopPrepared || preparedChannels == 0) return;
+
+    // the audio thread only reads or swaps the loop once a setting or command
+    // asking for it is in, and that is only after this returns
+    frozenLoop.setSize(preparedChannels, circularBufferSize);
+    spectralWorker.prepareLoop();
+    loopPrepared = true;
+}
+
+void FreezeEngine::prepareMorph()
+{
+    if (morphPrepared || preparedChannels == 0) return;
+
+    morphRing.setSize(preparedChannels, circularBufferSize);
+    morphLoop.setSize(preparedChannels, circularBufferSize);
+    morphPrepared = true;
+}
+
+void FreezeEngine::applyCommand(const Command& command)
+{
+    // stacked layers are handled by the STFT freeze alone, there is nothing to forecast or play out
+    bool layered = layering && activeMode == StftMode;
+
+    switch (command.type)
+    {
+        case FreezeCommand:
+            // a morph has to finish first
+            if (morphState != MorphIdle) break;
+            // already frozen: starting over would restart the forecast from the source mid-loop
+            if (!layered && (frozen || forecasting || freezePending)) break;
+            if (freezeRequestedAt == 0) freezeRequestedAt = command.time;
+            if (layered) stft.addLayer(circularBuffer, currentBufferWriteIndex, getLayerFadeHops());
+            else startFreeze();
+            break;
+        case ThawCommand:
+            if (morphState != MorphIdle) break;
+            if (layered) stft.fadeOutLayers(getLayerFadeHops());
+            else startThaw();
+            break;
+        case CancelCommand:
+            resetState();
+            break;
+        case LayerGainCommand:
+            if (layered) stft.fadeLayer(command.layer, command.gain, getLayerFadeHops());
+            break;
+        case RecallCommand:
+            startRecall(command.snapshot);
+            break;
+        case MorphCommand:
+            startMorph(command.snapshot, command.length);
+            break;
+    }
+}
+
+//==============================================================================
+void FreezeEngine::startFreeze()
+{
+    // a freeze of what is playing now wins over a recall still being resynthesised
+    recallPending = nullptr;
+    recallPosted = false;
+    frozen = true;
+    loopReady = false;
+
+    if (instantFreeze)
+        instantRequested = true;
+    else
+        forecasting = true;
+}
+
+void FreezeEngine::startThaw()
+{
+    if (! frozen) return;
+
+    frozen = false;
+    thawing = true;
+}
+
+void FreezeEngine::startRecall(const SpectralSnapshot* snapshot)
+{
+    bool live = !frozen && !forecasting && !thawing && !justThawed && instantFadeRemaining == 0;
+    if (activeMode != LoopMode || !live || snapshot->getBufferSize() != circularBufferSize) return;
+
+    // keeps playing live until the worker hands the loop back
+    recallPending = snapshot;
+    recallPosted = false;
+}
+
+void FreezeEngine::startMorph(const SpectralSnapshot* snapshot, int morphSamples)
+{
+    // only from a loop that is frozen and done fading in
+    bool settled = frozen && !forecasting && !freezePending && instantFadeRemaining == 0 && morphState == MorphIdle;
+    if (activeMode != LoopMode || !settled) return;
+    if (snapshot != nullptr && snapshot->getBufferSize() != circularBufferSize) return;
+
+    morphTarget = snapshot;
+    morphPosted = false;
+    morphHops = morphSamples / morph.getHopSize();
+
+    // a snapshot has to be resynthesised before it can be measured, live is measured as it plays
+    if (snapshot != nullptr) {
+        morphState = MorphResynthesising;
+        return;
+    }
+
+    morph.start(loopReady ? frozenLoop : circularBuffer, nullptr, morphHops);
+    morphState = MorphMeasuring;
+}
+
+void FreezeEngine::resetState()
+{
+    frozen = false;
+    thawing = false;
+    justThawed = false;
+    forecasting = false;
+    forecast = 0;
+    freezePending = false;
+    loopReady = false;
+    instantRequested = false;
+    instantFadeRemaining = 0;
+    handoffFadeRemaining = 0;
+    recallPending = nullptr;
+    recallPosted = false;
+    morphState = MorphIdle;
+    morphTarget = nullptr;
+    morphPosted = false;
+    morphFadeRemaining = 0;
+    morph.stop();
+    stftState = StftLive;
+    stftFadeRemaining = 0;
+    stft.clearLayers();
+    freezeRequestedAt = 0;
+}
+
+Telemetry::Branch FreezeEngine::getBranch() const
+{
+    if (activeMode == StftMode) {
+        if (layering)
+            return stft.hasActiveLayers() ? Telemetry::Frozen : Telemetry::Live;
+        if (frozen)
+            return stftState == StftFrozen ? Telemetry::Frozen : Telemetry::Forecasting;
+        return stftState == StftLive ? Telemetry::Live : Telemetry::Thawing;
+    }
+
+    if (thawing || justThawed) return Telemetry::Thawing;
+    if (forecasting) return Telemetry::Forecasting;
+    return frozen ? Telemetry::Frozen : Telemetry::Live;
+}
+
+void FreezeEngine::noteFrozenOutput()
+{
+    // taken when the block is processed, so the device's output latency comes on top
+    if (freezeRequestedAt == 0) return;
+
+    if (telemetry != nullptr)
+        telemetry->recordFreezeLatency(juce::Time::getHighResolutionTicks() - freezeRequestedAt);
+    freezeRequestedAt = 0;
+}
+
+//==============================================================================
+void FreezeEngine::process(const juce::AudioSourceChannelInfo& block)
+{
+    const juce::SpinLock::ScopedTryLockType lock(configLock);
+    if (! lock.isLocked()) {
+        block.clearActiveBufferRegion();
+        return;
+    }
+
+    auto startTicks = juce::Time::getHighResolutionTicks();
+
+    // only the commands already queued take part; each lands on its own sample,
+    // so the block is processed in spans from one to the next
+    int start1, size1, start2, size2;
+    commandFifo.prepareToRead(commandFifo.getNumReady(), start1, size1, start2, size2);
+    int numCommands = size1 + size2;
+    int nextCommand = 0;
+    int lastSample = juce::jmax(0, block.numSamples - 1);
+    auto getCommand = [&] (int i) -> const Command& { return commandQueue[i < size1 ? start1 + i : start2 + i - size1]; };
+    auto getOffset = [&] (int i) { return juce::jlimit(0, lastSample, getCommand(i).offset); };
+
+    Telemetry::Branch branch = Telemetry::Live;
+    int done = 0;
+
+    do {
+        // only change modes while nothing is frozen or fading
+        bool idle = !frozen && !forecasting && !thawing && !justThawed && !freezePending
+                    && instantFadeRemaining == 0 && stftState == StftLive && !stft.hasActiveLayers()
+                    && recallPending == nullptr && morphState == MorphIdle;
+        if (idle) {
+            activeMode = static_cast<FreezeMode>(requestedMode.load());
+            layering = requestedLayering;
+        }
+
+        while (nextCommand < numCommands && getOffset(nextCommand) <= done)
+            applyCommand(getCommand(nextCommand++));
+        if (done == 0) branch = getBranch();
+
+        int spanEnd = nextCommand < numCommands ? getOffset(nextCommand) : block.numSamples;
+        juce::AudioSourceChannelInfo span(block.buffer, block.startSample + done, spanEnd - done);
+
+        if (activeMode == StftMode) {
+            if (layering)
+                processLayers(span);
+            else
+                processStft(span);
+        }
+        else
+            processLoop(span);
+
+        done = spanEnd;
+    } while (done < block.numSamples);
+
+    commandFifo.finishedRead(numCommands);
+
+    if (telemetry != nullptr)
+        telemetry->recordCallback(branch, block.numSamples, juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+void FreezeEngine::processLoop(const juce::AudioSourceChannelInfo& block)
+{
+    // the forecast ends, and the thaw's crossfade starts and ends, on exact samples
+    // whatever the block size, so each span stops wherever the next of them falls
+    for (int done = 0; done < block.numSamples; )
+        done += processLoopSpan(juce::AudioSourceChannelInfo(block.buffer, block.startSample + done,
+                                                             block.numSamples - done));
+}
+
+int FreezeEngine::processLoopSpan(const juce::AudioSourceChannelInfo& block)
+{
+    auto* buffer = block.buffer;
+    int numSamples = block.numSamples;
+    int startSample = block.startSample;
+    int numChannels = juce::jmin(buffer->getNumChannels(), circularBuffer.getNumChannels());
+
+    // the raw ring loops until the spectral worker hands back the frozen loop, which then fades in
+    // over it; one that arrives during a thaw would hardly be heard, so the raw ring plays out instead
+    if (freezePending && !thawing) {
+        if (!snapshotPosted)
+            snapshotPosted = spectralWorker.postSnapshot(circularBuffer, freezeStart, loopRequested);
+        else if (spectralWorker.isResultReady())
+            fadeIntoCollectedLoop();
+    }
+
+    if (instantRequested)
+        takeInstantFreeze();
+
+    if (recallPending != nullptr) {
+        if (!recallPosted)
+            recallPosted = spectralWorker.postRecall(*recallPending);
+        if (recallPosted && spectralWorker.collectResult(circularBuffer, frozenLoop))
+            takeRecalledFreeze();
+    }
+
+    // once the glide has taken over, the frozen loop is no longer heard
+    if (morphState == Morphing || (morphState == MorphFadingOut && morphTarget == nullptr)) {
+        processMorph(block);
+        return numSamples;
+    }
+
+    if (thawing) {
+        // the loop plays out to the sample where the source paused, then crossfades back into it
+        int samplesBeforeFadeIn = getBufferDist(currentBufferReadIndex, currentBufferWriteIndex);
+
+        // a loop that is still fading in over the raw ring goes round once more rather than be cut short
+        if (samplesBeforeFadeIn == 0 && handoffFadeRemaining == 0) {
+            thawing = false;
+            justThawed = true;
+            // a frozen loop still in flight is stale now, leave it with the worker
+            freezePending = false;
+        }
+        else
+            numSamples = juce::jmin(numSamples, samplesBeforeFadeIn == 0 ? handoffFadeRemaining : samplesBeforeFadeIn);
+    }
+
+    // read next numsamples from the circular buffer
+    if (!forecasting && (frozen || thawing)) {
+        noteFrozenOutput();
+
+        int windowIndex = getBufferDist((currentBufferWriteIndex + 1) % circularBufferSize, currentBufferReadIndex);
+
+        // an instant freeze fades in over the live signal, so keep pulling the source until it has
+        int fadeSamples = juce::jmin(numSamples, instantFadeRemaining);
+        int fadePos = instantFadeSamples - instantFadeRemaining;
+        int handoffSamples = juce::jmin(numSamples, handoffFadeRemaining);
+        int handoffPos = instantFadeSamples - handoffFadeRemaining;
+        if (fadeSamples > 0) {
+            juce::AudioSourceChannelInfo fadeBlock(buffer, startSample, fadeSamples);
+
+            // at the end of a glide to a snapshot, the loop fades in over the glide instead
+            if (morphState == MorphFadingOut) {
+                fadeBlock.clearActiveBufferRegion();
+                morph.addTo(*buffer, startSample, fadeSamples, nullptr);
+            }
+            else
+                pullSource(fadeBlock);
+            instantFadeRemaining -= fadeSamples;
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* out = buffer->getWritePointer(channel, startSample);
+
+            // a prerendered loop already has the crossfade baked in, starting at the window's start
+            if (loopReady) {
+                const float* loop = frozenLoop.getReadPointer(channel);
+                juce::FloatVectorOperations::multiply(out, instantFadeOut + fadePos, fadeSamples);
+                FreezeKernels::addFromRingWithMultiply(out, loop, circularBufferSize, windowIndex,
+                                                       instantFadeIn + fadePos, fadeSamples);
+                FreezeKernels::copyFromRing(out + fadeSamples, loop, circularBufferSize,
+                                            FreezeKernels::wrap(windowIndex, fadeSamples, circularBufferSize),
+                                            numSamples - fadeSamples);
+            }
+            else
+                FreezeKernels::readLoop(out, circularBuffer.getReadPointer(channel),
+                                        samples, complement, circularBufferSize,
+                                        currentBufferReadIndex, windowIndex, numSamples);
+
+            if (handoffSamples > 0) {
+                juce::FloatVectorOperations::multiply(out, instantFadeIn + handoffPos, handoffSamples);
+                juce::FloatVectorOperations::addWithMultiply(out, handoffTail.getReadPointer(channel, handoffPos),
+                                                             instantFadeOut + handoffPos, handoffSamples);
+            }
+        }
+
+        handoffFadeRemaining -= handoffSamples;
+        currentBufferReadIndex = (currentBufferReadIndex + numSamples) % circularBufferSize;
+
+        if (morphState != MorphIdle)
+            processMorphOverLoop(juce::AudioSourceChannelInfo(buffer, startSample, numSamples));
+        return numSamples;
+    }
+    else // read next numsamples from the source into the output buffer, write them to the circle buffer
+    {
+        // the forecast and the thaw's crossfade each last exactly half a buffer
+        int progressSinceThawing = getBufferDist(currentBufferReadIndex, currentBufferWriteIndex);
+        if (forecasting)
+            numSamples = juce::jmin(numSamples, circularBufferSize / 2 - forecast);
+        if (justThawed)
+            numSamples = juce::jmin(numSamples, circularBufferSize / 2 - progressSinceThawing);
+
+        // read from source, if no modifications are made later (i.e. forecasting or justThawed), sends audio to output buffer
+        pullSource(juce::AudioSourceChannelInfo(buffer, startSample, numSamples));
+
+        // fade out the source against the first half of the circle buffer
+        int fadeOutWindowIdx = circularBufferSize / 2 + forecast;
+        int fadeInSampleIdx = (currentBufferWriteIndex + 1 + circularBufferSize / 2) % circularBufferSize;
+
+        // fade out the last half of the circle buffer against the source
+        bool fadingIn = justThawed;
+        int thawWindowIdx = circularBufferSize / 2 + progressSinceThawing;
+        int fadeOutSampleIdx = (currentBufferWriteIndex + circularBufferSize / 2) % circularBufferSize;
+        if (justThawed && progressSinceThawing + numSamples == circularBufferSize / 2) justThawed = false;
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* out = buffer->getWritePointer(channel, startSample);
+            float* ring = circularBuffer.getWritePointer(channel);
+
+            if (forecasting)
+                FreezeKernels::forecastFade(out, ring, samples, complement, circularBufferSize,
+                                            fadeInSampleIdx, fadeOutWindowIdx, numSamples);
+
+            if (fadingIn)
+                FreezeKernels::thawFade(out, ring, samples, complement, circularBufferSize,
+                                        fadeOutSampleIdx, thawWindowIdx, numSamples);
+
+            // write to circle buffer
+            FreezeKernels::copyToRing(ring, circularBufferSize, currentBufferWriteIndex, out, numSamples);
+        }
+
+        // keep the instant freeze analysis fed with what we just played
+        spectralWorker.pushHistory(*buffer, startSample, numSamples);
+
+        currentBufferWriteIndex = (currentBufferWriteIndex + numSamples) % circularBufferSize;
+
+        // inc count of forecasted samples and check if its time to freeze
+        if (forecasting) {
+            forecast += numSamples;
+            if (forecast == circularBufferSize / 2) {
+
+                // hand the forecast to the spectral worker instead of transforming it here
+                freezeStart = (currentBufferWriteIndex + 1) % circularBufferSize;
+                loopRequested = prerenderLoop;
+                snapshotPosted = spectralWorker.postSnapshot(circularBuffer, freezeStart, loopRequested);
+                freezePending = true;
+                if (snapshotPosted && spectralWorker.collectResult(circularBuffer, frozenLoop))
+                    collectFrozenLoop();
+
+                // reset read idx to start of buffer, stop forecasting; the rest of the block plays frozen
+                currentBufferReadIndex = freezeStart;
+                forecasting = false;
+                forecast = 0;
+            }
+        }
+    }
+
+    return numSamples;
+}
+
+void FreezeEngine::processMorphOverLoop(const juce::AudioSourceChannelInfo& block)
+{
+    auto* buffer = block.buffer;
+    int numSamples = block.numSamples;
+    int startSample = block.startSample;
+    int numChannels = juce::jmin(buffer->getNumChannels(), circularBuffer.getNumChannels());
+    int fadeSamples = juce::jmin(numSamples, morphFadeRemaining);
+    int fadePos = instantFadeSamples - morphFadeRemaining;
+
+    morph.setSharedPhase(sharedPhase);
+
+    switch (morphState) {
+        case MorphResynthesising:
+            // the snapshot comes back into the spare ring, the frozen loop keeps playing meanwhile
+            if (!morphPosted)
+                morphPosted = spectralWorker.postRecall(*morphTarget);
+            if (morphPosted && spectralWorker.collectResult(morphRing, morphLoop)) {
+                morph.start(loopReady ? frozenLoop : circularBuffer, &morphRing, morphHops);
+                morphState = MorphMeasuring;
+            }
+            break;
+        case MorphMeasuring:
+            if (morph.prepareAhead(numSamples)) {
+                morphFadeRemaining = instantFadeSamples;
+                morphState = MorphFadingIn;
+            }
+            break;
+        case MorphFadingIn:
+            // the loop fades out under the glide, then only the glide is left
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* out = buffer->getWritePointer(channel, startSample);
+                juce::FloatVectorOperations::multiply(out, instantFadeOut + fadePos, fadeSamples);
+                juce::FloatVectorOperations::clear(out + fadeSamples, numSamples - fadeSamples);
+            }
+            morph.addTo(*buffer, startSample, fadeSamples, instantFadeIn + fadePos);
+            morph.addTo(*buffer, startSample + fadeSamples, numSamples - fadeSamples, nullptr);
+
+            morphFadeRemaining -= fadeSamples;
+            if (morphFadeRemaining == 0) morphState = Morphing;
+            break;
+        case MorphFadingOut:
+            // the snapshot's loop has faded in over the last of the glide
+            if (instantFadeRemaining == 0) {
+                morph.stop();
+                morphState = MorphIdle;
+                morphTarget = nullptr;
+            }
+            break;
+        case MorphIdle:
+        case Morphing:
+            break;
+    }
+}
+
+void FreezeEngine::processMorph(const juce::AudioSourceChannelInfo& block)
+{
+    auto* buffer = block.buffer;
+    int numSamples = block.numSamples;
+    int startSample = block.startSample;
+    int numChannels = juce::jmin(buffer->getNumChannels(), circularBuffer.getNumChannels());
+    bool toLive = morphTarget == nullptr;
+
+    morph.setSharedPhase(sharedPhase);
+
+    if (toLive) {
+        // live plays on underneath, into the ring the target is measured from
+        pullSource(block);
+        for (int channel = 0; channel < numChannels; ++channel)
+            FreezeKernels::copyToRing(circularBuffer.getWritePointer(channel), circularBufferSize,
+                                      currentBufferWriteIndex, buffer->getReadPointer(channel, startSample), numSamples);
+
+        currentBufferWriteIndex = (currentBufferWriteIndex + numSamples) % circularBufferSize;
+        spectralWorker.pushHistory(*buffer, startSample, numSamples);
+        morph.setLiveTarget(circularBuffer, currentBufferWriteIndex);
+    }
+
+    if (morphState == Morphing) {
+        block.clearActiveBufferRegion();
+        morph.addTo(*buffer, startSample, numSamples, nullptr);
+
+        if (morph.hasArrived()) {
+            morphState = MorphFadingOut;
+            if (toLive) {
+                morphFadeRemaining = instantFadeSamples;
+                return;
+            }
+
+            // the resynthesised snapshot becomes the frozen loop and fades in over the glide
+            std::swap(circularBuffer, morphRing);
+            std::swap(frozenLoop, morphLoop);
+            fadeIntoUnwrappedLoop();
+        }
+        return;
+    }
+
+    // the glide fades out over the live signal, then the engine is simply live again
+    int fadeSamples = juce::jmin(numSamples, morphFadeRemaining);
+    int fadePos = instantFadeSamples - morphFadeRemaining;
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        juce::FloatVectorOperations::multiply(buffer->getWritePointer(channel, startSample),
+                                              instantFadeIn + fadePos, fadeSamples);
+    morph.addTo(*buffer, startSample, fadeSamples, instantFadeOut + fadePos);
+
+    morphFadeRemaining -= fadeSamples;
+    if (morphFadeRemaining == 0) {
+        morph.stop();
+        morphState = MorphIdle;
+        frozen = false;
+        loopReady = false;
+    }
+}
+
+void FreezeEngine::processStft(const juce::AudioSourceChannelInfo& block)
+{
+    auto* buffer = block.buffer;
+    int numSamples = block.numSamples;
+    int startSample = block.startSample;
+    int numChannels = juce::jmin(buffer->getNumChannels(), circularBuffer.getNumChannels());
+
+    stft.setSharedPhase(sharedPhase);
+
+    // the STFT freeze starts straight from the ring, it never forecasts or plays a loop out
+    forecasting = false;
+    instantRequested = false;
+    thawing = false;
+
+    if (frozen && (stftState == StftLive || stftState == StftFadingOut)) {
+        if (stftState == StftLive)
+            stft.capture(circularBuffer, currentBufferWriteIndex);
+        noteFrozenOutput();
+        // reversing a fade part way picks up at the same gain
+        stftFadeRemaining = instantFadeSamples - stftFadeRemaining;
+        stftState = StftFadingIn;
+    }
+    else if (!frozen && (stftState == StftFrozen || stftState == StftFadingIn)) {
+        stftFadeRemaining = instantFadeSamples - stftFadeRemaining;
+        stftState = StftFadingOut;
+    }
+
+    if (stftState == StftFrozen)
+        block.clearActiveBufferRegion();
+    else
+        pullSource(block);
+
+    int fadeSamples = (stftState == StftFadingIn || stftState == StftFadingOut) ? juce::jmin(numSamples, stftFadeRemaining) : 0;
+    int fadePos = instantFadeSamples - stftFadeRemaining;
+
+    switch (stftState) {
+        case StftFadingIn:
+            // live fades out under the resynthesis, then only the resynthesis is left
+            for (int channel = 0; channel < numChannels; ++channel) {
+                float* out = buffer->getWritePointer(channel, startSample);
+                juce::FloatVectorOperations::multiply(out, instantFadeOut + fadePos, fadeSamples);
+                juce::FloatVectorOperations::clear(out + fadeSamples, numSamples - fadeSamples);
+            }
+            stft.addTo(*buffer, startSample, fadeSamples, instantFadeIn + fadePos);
+            stft.addTo(*buffer, startSample + fadeSamples, numSamples - fadeSamples, nullptr);
+            break;
+        case StftFrozen:
+            stft.addTo(*buffer, startSample, numSamples, nullptr);
+            break;
+        case StftFadingOut:
+            for (int channel = 0; channel < numChannels; ++channel)
+                juce::FloatVectorOperations::multiply(buffer->getWritePointer(channel, startSample),
+                                                      instantFadeIn + fadePos, fadeSamples);
+            stft.addTo(*buffer, startSample, fadeSamples, instantFadeOut + fadePos);
+            break;
+        case StftLive:
+            break;
+    }
+
+    stftFadeRemaining -= fadeSamples;
+    if (stftFadeRemaining == 0) {
+        if (stftState == StftFadingIn) stftState = StftFrozen;
+        else if (stftState == StftFadingOut) stftState = StftLive;
+    }
+
+    // keep the ring and the rolling analysis fed while anything live is playing
+    if (stftState != StftFrozen) {
+        for (int channel = 0; channel < numChannels; ++channel)
+            FreezeKernels::copyToRing(circularBuffer.getWritePointer(channel), circularBufferSize,
+                                      currentBufferWriteIndex, buffer->getReadPointer(channel, startSample), numSamples);
+
+        currentBufferWriteIndex = (currentBufferWriteIndex + numSamples) % circularBufferSize;
+        spectralWorker.pushHistory(*buffer, startSample, numSamples);
+    }
+}
+
+void FreezeEngine::pullSource(const juce::AudioSourceChannelInfo& block)
+{
+    // live input is already sitting in the block
+    if (liveInput) return;
+
+    if (source == nullptr) {
+        block.clearActiveBufferRegion();
+        return;
+    }
+
+    source->getNextAudioBlock(block);
+}
+
+void FreezeEngine::processLayers(const juce::AudioSourceChannelInfo& block)
+{
+    auto* buffer = block.buffer;
+    int numSamples = block.numSamples;
+    int startSample = block.startSample;
+    int numChannels = juce::jmin(buffer->getNumChannels(), circularBuffer.getNumChannels());
+
+    // live always plays and always feeds the ring, so any moment can be stacked
+    pullSource(block);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+        FreezeKernels::copyToRing(circularBuffer.getWritePointer(channel), circularBufferSize,
+                                  currentBufferWriteIndex, buffer->getReadPointer(channel, startSample), numSamples);
+
+    currentBufferWriteIndex = (currentBufferWriteIndex + numSamples) % circularBufferSize;
+    spectralWorker.pushHistory(*buffer, startSample, numSamples);
+
+    // a new layer starts fading in from this block
+    noteFrozenOutput();
+
+    // the layers fade per hop, one shared resynthesis on top of the live signal
+    stft.setSharedPhase(sharedPhase);
+    stft.addTo(*buffer, startSample, numSamples, nullptr);
+}
+
+int FreezeEngine::getLayerFadeHops() const
+{
+    return juce::jmax(1, instantFadeSamples / stft.getHopSize());
+}
+
+void FreezeEngine::takeInstantFreeze()
+{
+    instantRequested = false;
+
+    // nothing analysed yet (e.g. just after starting), fall back to a forecast
+    if (! spectralWorker.takeRollingResult(circularBuffer, frozenLoop)) {
+        forecasting = true;
+        return;
+    }
+
+    fadeIntoUnwrappedLoop();
+}
+
+void FreezeEngine::takeRecalledFreeze()
+{
+    recallPending = nullptr;
+    recallPosted = false;
+    frozen = true;
+    fadeIntoUnwrappedLoop();
+}
+
+void FreezeEngine::fadeIntoUnwrappedLoop()
+{
+    // the loop is unwrapped, so it starts at index 0
+    currentBufferWriteIndex = circularBufferSize - 1;
+    currentBufferReadIndex = 0;
+    freezePending = false;
+    loopRequested = true;
+    loopReady = true;
+    instantFadeRemaining = instantFadeSamples;
+}
+
+void FreezeEngine::collectFrozenLoop()
+{
+    if (telemetry != nullptr)
+        telemetry->recordTransform(spectralWorker.getLastTransformTicks());
+
+    freezePending = false;
+    loopReady = loopRequested;
+}
+
+void FreezeEngine::fadeIntoCollectedLoop()
+{
+    // render what the raw ring would play next before it is swapped out, then fade
+    // from that into the loop the same way an instant freeze fades in over live
+    int windowIndex = getBufferDist((currentBufferWriteIndex + 1) % circularBufferSize, currentBufferReadIndex);
+    for (int channel = 0; channel < handoffTail.getNumChannels(); ++channel)
+        FreezeKernels::readLoop(handoffTail.getWritePointer(channel), circularBuffer.getReadPointer(channel),
+                                samples, complement, circularBufferSize,
+                                currentBufferReadIndex, windowIndex, instantFadeSamples);
+
+    spectralWorker.collectResult(circularBuffer, frozenLoop);
+    collectFrozenLoop();
+    handoffFadeRemaining = instantFadeSamples;
+}
+
+// distance in the forward direction from one circular buffer index to another
+int FreezeEngine::getBufferDist(int from, int to) {
+    int dist = to - from;
+    return (dist < 0) ? dist + circularBufferSize : dist;
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectralCache.h"
+#include "SpectralMorph.h"
+#include "SpectralWorker.h"
+#include "StftFreeze.h"
+#include "Telemetry.h"
+
+//==============================================================================
+/*
+    The freeze DSP without any GUI or device attached.
+
+    Audio is pulled from a PositionableAudioSource while the engine is live and
+    written into the circular buffer. In live input mode there is no source: the
+    block handed to process() already holds the device input and is frozen in
+    place, so nothing is copied or allocated on the way through. freeze() forecasts half a buffer, fading
+    the source out, then hands the buffer to the spectral worker and loops the
+    result; thaw() plays the loop out to where the source paused and crossfades back.
+    Commands, the end of the forecast and the start and end of the thaw's
+    crossfade all land on an exact sample: a block is played in spans split
+    wherever one of them falls, so any block size works, down to a few samples.
+    A freeze can also glide into a saved spectrum, or back out to the live
+    signal, through a SpectralMorph that spreads its work over the callbacks.
+*/
+class FreezeEngine
+{
+public:
+    enum FreezeMode
+    {
+        LoopMode,
+        StftMode
+    };
+
+    //==============================================================================
+    FreezeEngine();
+    ~FreezeEngine();
+
+    //==============================================================================
+    // allocates the circular buffer and window, and the frozen loop if a setting
+    // below already asks for one; with `synchronous` the freeze
+    // transform runs inline in process() instead of on the spectral worker,
+    // which keeps offline renders independent of thread timing.
+    // freezeSamples can be any length, odd lengths are rounded up by one
+    void prepare(int numChannels, int freezeSamples, bool synchronous = false);
+    void release();
+
+    // message thread: re-prepare for a new freeze length while audio keeps
+    // running. anything frozen is dropped and the blocks processed during the
+    // switch come out silent
+    void setFreezeLength(int freezeSamples);
+
+    // the source audio is pulled from while the engine is not frozen
+    void setSource(juce::PositionableAudioSource* newSource);
+    // take the audio already in each block (device input) instead of pulling the
+    // source; a live signal can't be rewound, so thawing just crossfades back in
+    void setLiveInput(bool shouldUseLiveInput) { liveInput = shouldUseLiveInput; }
+    bool isLiveInput() const { return liveInput; }
+
+    // where process() reports its timings; set before the audio thread runs
+    void setTelemetry(Telemetry* newTelemetry) { telemetry = newTelemetry; }
+
+    //==============================================================================
+    void process(const juce::AudioSourceChannelInfo& block);
+
+    // each returns false if the command queue is full and the command was dropped.
+    // freeze() and thaw() take effect sampleOffset samples into the next block
+    // processed (its last sample at most); commands always keep their order
+    bool freeze(int sampleOffset = 0);
+    bool thaw(int sampleOffset = 0);
+    // drops a freeze or forecast in progress without thawing (e.g. on stop)
+    bool cancel();
+    // loop mode, while live: freeze into a saved spectrum instead of the audio just
+    // played, fading in once it is resynthesised. ignored unless it was saved at
+    // the current freeze length; `snapshot` must stay loaded while the engine runs.
+    // call it from the message thread, as the first one allocates the frozen loop
+    bool recall(const SpectralSnapshot& snapshot);
+    // message thread: the magnitudes of the last forecast freeze, for saving with
+    // SpectralSnapshot::write(); false if there hasn't been one since prepare()
+    bool getFrozenSpectrum(juce::AudioSampleBuffer& magnitudes) { return spectralWorker.getFrozenMagnitudes(magnitudes); }
+    // loop mode, while frozen: glide over morphSamples from the frozen spectrum to a
+    // saved one of the same freeze length, then stay frozen on it. the frozen loop
+    // keeps playing while the snapshot is resynthesised and both ends are measured.
+    // the first one also allocates a spare ring and loop for the snapshot
+    bool morphTo(const SpectralSnapshot& snapshot, int morphSamples);
+    // loop mode, while frozen: glide over morphSamples from the frozen spectrum to
+    // that of the live signal, which plays on underneath, then crossfade into it.
+    // freeze() and thaw() are ignored until a morph has finished
+    bool morphToLive(int morphSamples);
+
+    // render the crossfaded loop once per freeze so frozen playback is a plain
+    // copy; takes effect from the next freeze
+    void setPrerenderedLoop(bool shouldPrerender);
+
+    // one random phase field for all channels instead of one per channel, in
+    // both freeze modes; keeps a multichannel image coherent
+    void setSharedPhase(bool shouldShare);
+    // draw every random phase from this seed, so the same input and commands give
+    // the same output (offline renders, regression checks); applied at the next
+    // prepare(). without one a random seed is used
+    void setPhaseSeed(juce::uint64 seed) { phaseSeed = seed; }
+
+    // freeze straight away from a loop the worker keeps re-analysing in the
+    // background instead of forecasting half a buffer first
+    void setInstantFreeze(bool shouldFreezeInstantly);
+
+    // switches between the looped and the streaming STFT freeze; takes effect
+    // the next time the engine is fully thawed
+    void setFreezeMode(FreezeMode newMode) { requestedMode = newMode; }
+
+    // in STFT mode, stack freezes instead of replacing them: the live signal keeps
+    // playing, each freeze() fades in another layer on top and thaw() fades them
+    // all out. takes effect, like the mode, once nothing is frozen
+    void setLayering(bool shouldLayer) { requestedLayering = shouldLayer; }
+    // fades one layer (numbered by slot, lowest free first) to `gain`; at zero it is dropped
+    bool setLayerGain(int layer, float gain);
+    // frame, hop and window of the STFT mode, applied at the next prepare()
+    void setStftSettings(int frameSize, int hopSize,
+                         juce::dsp::WindowingFunction<float>::WindowingMethod windowType);
+
+    // audio thread (or the thread calling process() offline)
+    bool isFrozen() const { return frozen; }
+    // from the end of a forecast until the next block collects the spectral worker's loop,
+    // and whether that loop is back and waiting to be collected
+    bool isAwaitingLoop() const { return freezePending; }
+    bool isLoopCollectable() const { return freezePending && spectralWorker.isResultReady(); }
+    int getFreezeSamples() const { return circularBufferSize; }
+
+private:
+    enum CommandType
+    {
+        FreezeCommand,
+        ThawCommand,
+        CancelCommand,
+        LayerGainCommand,
+        RecallCommand,
+        MorphCommand
+    };
+
+    struct Command
+    {
+        CommandType type;
+        int layer;
+        float gain;
+        const SpectralSnapshot* snapshot;
+        int length;
+        int offset;
+        // when it was pushed, for the freeze latency
+        juce::int64 time;
+    };
+
+    bool pushCommand(Command command);
+    void prepareLoop();
+    void prepareMorph();
+    void applyCommand(const Command& command);
+    void startFreeze();
+    void startThaw();
+    void startRecall(const SpectralSnapshot* snapshot);
+    void takeRecalledFreeze();
+    void fadeIntoUnwrappedLoop();
+    void startMorph(const SpectralSnapshot* snapshot, int morphSamples);
+    void processMorphOverLoop(const juce::AudioSourceChannelInfo& block);
+    void processMorph(const juce::AudioSourceChannelInfo& block);
+    void resetState();
+    Telemetry::Branch getBranch() const;
+    void noteFrozenOutput();
+    void pullSource(const juce::AudioSourceChannelInfo& block);
+    void collectFrozenLoop();
+    void fadeIntoCollectedLoop();
+    void takeInstantFreeze();
+    void processLoop(const juce::AudioSourceChannelInfo& block);
+    int processLoopSpan(const juce::AudioSourceChannelInfo& block);
+    void processStft(const juce::AudioSourceChannelInfo& block);
+    void processLayers(const juce::AudioSourceChannelInfo& block);
+    int getLayerFadeHops() const;
+    int getBufferDist(int from, int to);
+
+    static constexpr int commandQueueSize = 64;
+    juce::AbstractFifo commandFifo;
+    Command commandQueue[commandQueueSize];
+
+    juce::SpinLock configLock;
+    Telemetry* telemetry;
+    // when the freeze that has yet to be heard was requested, or 0
+    juce::int64 freezeRequestedAt;
+    int preparedChannels;
+    bool preparedSynchronous;
+
+    juce::PositionableAudioSource* source;
+    std::atomic<bool> liveInput;
+
+    juce::AudioSampleBuffer circularBuffer;
+    juce::AudioSampleBuffer frozenLoop;
+    // message thread: frozenLoop, and the morph's ring and loop, stay empty until a
+    // setting or command that plays them is first used, then keep up with prepare()
+    bool loopPrepared;
+    bool morphPrepared;
+    juce::SharedResourcePointer<SpectralCache> cache;
+    SpectralCache::WindowTable::Ptr crossfadeTable;
+    const float* samples;
+    const float* complement;
+    SpectralWorker spectralWorker;
+    int circularBufferSize;
+    int currentBufferReadIndex;
+    int currentBufferWriteIndex;
+    int forecast;
+    bool frozen;
+    bool thawing;
+    bool justThawed;
+    bool forecasting;
+    bool freezePending;
+    bool snapshotPosted;
+    int freezeStart;
+    std::atomic<bool> prerenderLoop;
+    bool loopRequested;
+    bool loopReady;
+    std::atomic<bool> sharedPhase;
+    juce::uint64 phaseSeed;
+    std::atomic<bool> instantFreeze;
+    bool instantRequested;
+    juce::HeapBlock<float> instantFadeIn;
+    juce::HeapBlock<float> instantFadeOut;
+    int instantFadeSamples;
+    int instantFadeRemaining;
+    // the raw ring plays from the end of the forecast until the worker's loop arrives;
+    // what it would have played next fades out under the loop over handoffFadeRemaining
+    juce::AudioSampleBuffer handoffTail;
+    int handoffFadeRemaining;
+    const SpectralSnapshot* recallPending;
+    bool recallPosted;
+
+    enum MorphState
+    {
+        MorphIdle,
+        MorphResynthesising,
+        MorphMeasuring,
+        MorphFadingIn,
+        Morphing,
+        MorphFadingOut
+    };
+
+    // a snapshot target is resynthesised by the worker into morphRing and morphLoop,
+    // which become the frozen loop once the glide has arrived
+    SpectralMorph morph;
+    MorphState morphState;
+    const SpectralSnapshot* morphTarget;
+    bool morphPosted;
+    int morphHops;
+    int morphFadeRemaining;
+    juce::AudioSampleBuffer morphRing;
+    juce::AudioSampleBuffer morphLoop;
+
+    enum StftState
+    {
+        StftLive,
+        StftFadingIn,
+        StftFrozen,
+        StftFadingOut
+    };
+
+    StftFreeze stft;
+    std::atomic<int> requestedMode;
+    FreezeMode activeMode;
+    std::atomic<bool> requestedLayering;
+    bool layering;
+    StftState stftState;
+    int stftFadeRemaining;
+    int stftFrameSize;
+    int stftHopSize;
+    juce::dsp::WindowingFunction<float>::WindowingMethod stftWindow;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (FreezeEngine)
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/*
+    Block kernels for the freeze engine's playback paths.
+
+    Every index into the circular buffer wraps at most once per block, so each
+    kernel splits its block into the few contiguous runs between wrap points and
+    hands those to FloatVectorOperations. No modulo or bounds check is done per
+    sample.
+*/
+namespace FreezeKernels
+{
+    // advance a ring index by n, assuming n <= size
+    inline int wrap(int index, int n, int size)
+    {
+        index += n;
+        return (index >= size) ? index - size : index;
+    }
+
+    // out[i] = ring[ringIndex + i] for a block that may wrap the ring
+    inline void copyFromRing(float* out, const float* ring, int size, int ringIndex, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::copy(out, ring + ringIndex, firstSpan);
+        juce::FloatVectorOperations::copy(out + firstSpan, ring, numSamples - firstSpan);
+    }
+
+    // ring[ringIndex + i] = in[i] for a block that may wrap the ring
+    inline void copyToRing(float* ring, int size, int ringIndex, const float* in, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::copy(ring + ringIndex, in, firstSpan);
+        juce::FloatVectorOperations::copy(ring, in + firstSpan, numSamples - firstSpan);
+    }
+
+    // ring[ringIndex + i] += in[i]
+    inline void addToRing(float* ring, int size, int ringIndex, const float* in, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::add(ring + ringIndex, in, firstSpan);
+        juce::FloatVectorOperations::add(ring, in + firstSpan, numSamples - firstSpan);
+    }
+
+    // ring[ringIndex + i] = 0
+    inline void clearRing(float* ring, int size, int ringIndex, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::clear(ring + ringIndex, firstSpan);
+        juce::FloatVectorOperations::clear(ring, numSamples - firstSpan);
+    }
+
+    // out[i] += ring[ringIndex + i]
+    inline void addFromRing(float* out, const float* ring, int size, int ringIndex, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::add(out, ring + ringIndex, firstSpan);
+        juce::FloatVectorOperations::add(out + firstSpan, ring, numSamples - firstSpan);
+    }
+
+    // out[i] += ring[ringIndex + i] * gains[i]
+    inline void addFromRingWithMultiply(float* out, const float* ring, int size, int ringIndex,
+                                        const float* gains, int numSamples)
+    {
+        int firstSpan = juce::jmin(numSamples, size - ringIndex);
+        juce::FloatVectorOperations::addWithMultiply(out, ring + ringIndex, gains, firstSpan);
+        juce::FloatVectorOperations::addWithMultiply(out + firstSpan, ring, gains + firstSpan, numSamples - firstSpan);
+    }
+
+    //==============================================================================
+    // frozen playback: the two taps half a buffer apart, crossfaded by the window
+    // out[i] = ring[r + i] * window[w + i] + ring[r + i + size / 2] * complement[w + i]
+    inline void readLoop(float* out, const float* ring, const float* window, const float* complement,
+                         int size, int readIndex, int windowIndex, int numSamples)
+    {
+        int secondReadIndex = wrap(readIndex, size / 2, size);
+
+        while (numSamples > 0)
+        {
+            // run up to whichever of the three indices wraps first
+            int span = juce::jmin(numSamples, size - readIndex, size - secondReadIndex, size - windowIndex);
+
+            juce::FloatVectorOperations::multiply(out, ring + readIndex, window + windowIndex, span);
+            juce::FloatVectorOperations::addWithMultiply(out, ring + secondReadIndex, complement + windowIndex, span);
+
+            out += span;
+            numSamples -= span;
+            readIndex = wrap(readIndex, span, size);
+            secondReadIndex = wrap(secondReadIndex, span, size);
+            windowIndex = wrap(windowIndex, span, size);
+        }
+    }
+
+    // forecasting: fade the source out over the second half of the window while
+    // fading in the ring from ringIndex. Before the window starts (windowIndex
+    // below size / 2) the source passes through, past its end only the ring is left
+    inline void forecastFade(float* out, const float* ring, const float* window, const float* complement,
+                             int size, int ringIndex, int windowIndex, int numSamples)
+    {
+        int before = juce::jlimit(0, numSamples, size / 2 - windowIndex);
+        out += before;
+        ringIndex = wrap(ringIndex, before, size);
+        windowIndex += before;
+        numSamples -= before;
+
+        int windowed = juce::jlimit(0, numSamples, size - windowIndex);
+        juce::FloatVectorOperations::multiply(out, window + windowIndex, windowed);
+        addFromRingWithMultiply(out, ring, size, ringIndex, complement + windowIndex, windowed);
+
+        copyFromRing(out + windowed, ring, size, wrap(ringIndex, windowed, size), numSamples - windowed);
+    }
+
+    // just thawed: fade the ring from ringIndex out over the second half of the
+    // window while the source fades back in; past the window the source passes through
+    inline void thawFade(float* out, const float* ring, const float* window, const float* complement,
+                         int size, int ringIndex, int windowIndex, int numSamples)
+    {
+        int windowed = juce::jlimit(0, numSamples, size - windowIndex);
+        juce::FloatVectorOperations::multiply(out, complement + windowIndex, windowed);
+        addFromRingWithMultiply(out, ring, size, ringIndex, window + windowIndex, windowed);
+    }
+}
@@ -1,29 +1,34 @@
 #include "MainComponent.h"
-#include <random> // For generating random phase
 
 //==============================================================================
 MainComponent::MainComponent() 
     : state(Unprimed),
+      readAheadThread("Audio read-ahead"),
       openButton("Open"),
       playButton("Play"),
       stopButton("Stop"),
       freezeButton("Freeze"),
-      fft(0),
-      circularBufferSize(0),
-      currentBufferReadIndex(0),
-      currentBufferWriteIndex(0),
-      forecast(0),
-      thawing(false),
-      justThawed(false),
-      forecasting(false),
+      instantButton("Instant freeze"),
+      stftButton("STFT freeze"),
+      layerButton("Layer freezes"),
+      liveButton("Live input"),
+      saveStatsButton("Save stats"),
+      saveSnapshotButton("Save snapshot"),
+      quantizeButton("16-bit"),
+      recallButton("Recall"),
+      morphButton("Morph"),
+      morphOutButton("Morph out"),
+      timerTicks(0),
+      library(juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                  .getChildFile("AudioFreezeFrame").getChildFile("Snapshots")),
       freezeSamples(32768),
-      samples(nullptr),
-      samplesBeforeFadeOut(0)
+      numInputChannels(0),
+      currentSampleRate(44100.0)
       
 {
     // Make sure you set the size of the component after
     // you add any child components.
-    setSize (200, 200);
+    setSize (480, 750);
 
     // Some platforms require permissions to open input channels so request that here
     if (juce::RuntimePermissions::isRequired (juce::RuntimePermissions::recordAudio)
@@ -35,7 +40,7 @@ MainComponent::MainComponent()
     else
     {
         // Specify the number of input and output channels that we want to open
-        setAudioChannels (0, 2);
+        setAudioChannels (2, 2);
     }
     
     openButton.onClick = [this] { openButtonClicked(); };
@@ -55,31 +60,107 @@ MainComponent::MainComponent()
     freezeButton.setColour(juce::TextButton::buttonColourId, juce::Colours::lightblue);
     freezeButton.setEnabled(false);
     addAndMakeVisible(&freezeButton);
+    
+    instantButton.onClick = [this] { engine.setInstantFreeze(instantButton.getToggleState()); };
+    addAndMakeVisible(&instantButton);
+    
+    stftButton.onClick = [this] { engine.setFreezeMode(stftButton.getToggleState() ? FreezeEngine::StftMode : FreezeEngine::LoopMode); };
+    addAndMakeVisible(&stftButton);
+    
+    layerButton.onClick = [this] { engine.setLayering(layerButton.getToggleState()); };
+    addAndMakeVisible(&layerButton);
+    
+    liveButton.onClick = [this] { liveButtonClicked(); };
+    liveButton.setEnabled(false);
+    addAndMakeVisible(&liveButton);
+    
+    latencyLabel.setJustificationType(juce::Justification::centred);
+    addAndMakeVisible(&latencyLabel);
+    
+    // item ids are the freeze length in milliseconds
+    lengthBox.setTextWhenNothingSelected("Freeze length");
+    for (int milliseconds : { 250, 500, 750, 1000, 2000, 4000 })
+        lengthBox.addItem(juce::String(milliseconds / 1000.0, 2) + " s", milliseconds);
+    lengthBox.onChange = [this] { lengthChanged(); };
+    addAndMakeVisible(&lengthBox);
+
+    saveStatsButton.onClick = [this] { saveStatsClicked(); };
+    addAndMakeVisible(&saveStatsButton);
+
+    saveSnapshotButton.onClick = [this] { saveSnapshotClicked(); };
+    saveSnapshotButton.setEnabled(false);
+    addAndMakeVisible(&saveSnapshotButton);
+    addAndMakeVisible(&quantizeButton);
+
+    // item ids are the library index plus one
+    snapshotBox.setTextWhenNothingSelected("Snapshots");
+    addAndMakeVisible(&snapshotBox);
+
+    recallButton.onClick = [this] { recallClicked(); };
+    recallButton.setEnabled(false);
+    addAndMakeVisible(&recallButton);
+
+    morphButton.onClick = [this] { morphClicked(); };
+    morphButton.setEnabled(false);
+    addAndMakeVisible(&morphButton);
+
+    morphOutButton.onClick = [this] { morphOutClicked(); };
+    morphOutButton.setEnabled(false);
+    addAndMakeVisible(&morphOutButton);
+
+    library.scan();
+    updateSnapshotBox();
 
     formatManager.registerBasicFormats();
+    engine.setPrerenderedLoop(true);
+    engine.setTelemetry(&telemetry);
+    readAheadThread.startThread();
+    startTimerHz(viewRefreshHz);
 }
 
 MainComponent::~MainComponent()
 {
     // This shuts down the audio device and clears the audio source.
     shutdownAudio();
+    transport.setSource(nullptr);
+    readAheadThread.removeTimeSliceClient(&overview);
+    readAheadThread.stopThread(2000);
 }
 
 //==============================================================================
 void MainComponent::prepareToPlay (int samplesPerBlockExpected, double sampleRate)
 {
     DBG("Preparing to play");
-    circularBufferSize = static_cast<int>(freezeSamples);
-    circularBuffer.setSize(2, circularBufferSize); // Stereo (2 channels)
-    samples = new float[circularBufferSize];
-    fft = juce::dsp::FFT(std::log2(circularBufferSize));
-    
-    // juce error: noramlisation param is inverted?
-    juce::dsp::WindowingFunction<float>::fillWindowingTables(samples, circularBufferSize, juce::dsp::WindowingFunction<float>::hann, false);
-    circularBuffer.clear();
-    currentBufferWriteIndex = 0;
-    currentBufferReadIndex = 0;
+
+    currentSampleRate = sampleRate;
+
+    // one ring per output channel the device actually opened, stereo or a surround/ambisonic layout alike
+    int numOutputChannels = 2;
+    juce::String latencyText;
+    if (auto* device = deviceManager.getCurrentAudioDevice())
+    {
+        numInputChannels = device->getActiveInputChannels().countNumberOfSetBits();
+        numOutputChannels = juce::jmax(1, device->getActiveOutputChannels().countNumberOfSetBits());
+
+        // round trip as the device reports it: input and output latency plus the block we process in place
+        int latency = device->getInputLatencyInSamples() + device->getOutputLatencyInSamples() + samplesPerBlockExpected;
+        latencyText = "Round trip: " + juce::String(1000.0 * latency / sampleRate, 1) + " ms (" + juce::String(latency) + " samples)";
+    }
+
+    telemetry.prepare(sampleRate);
+    engine.prepare(numOutputChannels, freezeSamples);
+    engine.setSource(&transport);
     transport.prepareToPlay(samplesPerBlockExpected, sampleRate);
+
+    // this can be called off the message thread
+    juce::Component::SafePointer<MainComponent> safeThis(this);
+    juce::MessageManager::callAsync([safeThis, latencyText]
+    {
+        if (safeThis == nullptr) return;
+        safeThis->latencyLabel.setText(latencyText, juce::dontSendNotification);
+        safeThis->liveButton.setEnabled(safeThis->numInputChannels > 0);
+        safeThis->updateSnapshotBox();
+    });
 }
 
 void MainComponent::openButtonClicked()
@@ -89,23 +170,65 @@ void MainComponent::openButtonClicked()
     // If the user chooses a file
     if (chooser.browseForFileToOpen()) {
         juce::File myFile = chooser.getResult();
-        // Read file
-        juce::AudioFormatReader* reader = formatManager.createReaderFor(myFile);
+        double sampleRate = 0.0;
+        std::unique_ptr<juce::PositionableAudioSource> tempSource = createPlaySource(myFile, sampleRate);
         
-        if (reader)
+        if (tempSource)
         {
-            std::unique_ptr<juce::AudioFormatReaderSource> tempSource (new juce::AudioFormatReaderSource (reader, true));
-            
-            transport.setSource(tempSource.get());
+            // decode on the read-ahead thread so the audio callback only ever copies
+            transport.setSource(tempSource.get(), readAheadSamples, &readAheadThread, sampleRate);
             transportStateChanged(Stopped);
             
             playSource.reset(tempSource.release());
+
+            // the overview is decoded on the same thread, between read-ahead slices
+            readAheadThread.removeTimeSliceClient(&overview);
+            if (overview.load(formatManager, myFile))
+                readAheadThread.addTimeSliceClient(&overview);
         }
     }
 }
 
+std::unique_ptr<juce::PositionableAudioSource> MainComponent::createPlaySource(const juce::File& file, double& sampleRate)
+{
+    // uncompressed files are mapped rather than read, so seeking anywhere in even a
+    // very long recording is just a page fault on the read-ahead thread
+    if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+    {
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped (format->createMemoryMappedReader(file));
+        if (mapped != nullptr && mapped->mapEntireFile())
+        {
+            sampleRate = mapped->sampleRate;
+            return std::make_unique<juce::AudioFormatReaderSource>(mapped.release(), true);
+        }
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor(file));
+    if (reader == nullptr) return nullptr;
+    sampleRate = reader->sampleRate;
+
+    // short compressed files are decoded up front so seeks never have to re-decode
+    if (reader->lengthInSamples <= static_cast<juce::int64>(maxDecodedSeconds * reader->sampleRate))
+    {
+        juce::AudioSampleBuffer decoded(static_cast<int>(reader->numChannels), static_cast<int>(reader->lengthInSamples));
+        if (reader->read(&decoded, 0, decoded.getNumSamples(), 0, true, true))
+            return std::make_unique<juce::MemoryAudioSource>(decoded, true, false);
+    }
+
+    // anything longer streams through the read-ahead buffer
+    return std::make_unique<juce::AudioFormatReaderSource>(reader.release(), true);
+}
+
 void MainComponent::playButtonClicked()
 {
+    // while stacking, play fades the layers out and the live signal never stopped
+    if (state == Starting)
+    {
+        engine.thaw();
+        playButton.setEnabled(false);
+        return;
+    }
+
     transportStateChanged(Starting);
 }
 
@@ -116,9 +239,118 @@ void MainComponent::stopButtonClicked()
 
 void MainComponent::freezeButtonClicked()
 {
+    // stacked freezes play over the live signal, so every press adds another layer
+    if (stftButton.getToggleState() && layerButton.getToggleState())
+    {
+        engine.freeze();
+        playButton.setEnabled(true);
+        return;
+    }
+
+    engine.freeze();
     transportStateChanged(Freezing);
 }
 
+void MainComponent::liveButtonClicked()
+{
+    bool live = liveButton.getToggleState();
+
+    // drop whatever was frozen and stop the file before switching what feeds the engine
+    transportStateChanged(Stopping);
+    engine.setLiveInput(live);
+    openButton.setEnabled(!live);
+
+    if (live)
+        transportStateChanged(Starting);
+    else
+        transportStateChanged(playSource != nullptr ? Stopped : Unprimed);
+}
+
+void MainComponent::lengthChanged()
+{
+    // any length works, it need not be a power of two
+    freezeSamples = juce::roundToInt(lengthBox.getSelectedId() * currentSampleRate / 1000.0);
+
+    // whatever was frozen is gone after the switch
+    transportStateChanged(state == Freezing ? Starting : state);
+    engine.setFreezeLength(freezeSamples);
+}
+
+void MainComponent::saveStatsClicked()
+{
+    juce::FileChooser chooser ("Save timing statistics", juce::File::getSpecialLocation(juce::File::userDocumentsDirectory).getChildFile("freeze-stats.csv"), "*.csv");
+    if (chooser.browseForFileToSave(true))
+        telemetry.writeCsv(chooser.getResult());
+}
+
+void MainComponent::saveSnapshotClicked()
+{
+    juce::AudioSampleBuffer magnitudes;
+    if (! engine.getFrozenSpectrum(magnitudes)) return;
+
+    int index = library.add(juce::Time::getCurrentTime().formatted("%Y-%m-%d %H-%M-%S"), magnitudes,
+                            engine.getFreezeSamples(), currentSampleRate, quantizeButton.getToggleState());
+    updateSnapshotBox();
+    if (index >= 0)
+        snapshotBox.setSelectedId(index + 1, juce::dontSendNotification);
+}
+
+void MainComponent::recallClicked()
+{
+    int index = snapshotBox.getSelectedId() - 1;
+    if (index < 0 || stftButton.getToggleState()) return;
+
+    // a snapshot only fits the freeze length it was saved at, and unlike the length
+    // the device's sample rate can't be switched to match it
+    const SpectralSnapshot& snapshot = library.getSnapshot(index);
+    if (! snapshot.isForSampleRate(currentSampleRate)) return;
+    if (snapshot.getBufferSize() != engine.getFreezeSamples())
+    {
+        freezeSamples = snapshot.getBufferSize();
+        lengthBox.setSelectedId(0, juce::dontSendNotification);
+        engine.setFreezeLength(freezeSamples);
+    }
+
+    if (engine.recall(snapshot))
+        transportStateChanged(Freezing);
+}
+
+void MainComponent::morphClicked()
+{
+    // unlike a recall, a morph can't switch lengths without dropping the freeze it starts from
+    int index = snapshotBox.getSelectedId() - 1;
+    if (index < 0 || library.getSnapshot(index).getBufferSize() != engine.getFreezeSamples()
+        || ! library.getSnapshot(index).isForSampleRate(currentSampleRate)) return;
+
+    engine.morphTo(library.getSnapshot(index), juce::roundToInt(morphSeconds * currentSampleRate));
+}
+
+void MainComponent::morphOutClicked()
+{
+    // if the engine can't morph right now, the thaw this state change sends goes through instead
+    engine.morphToLive(juce::roundToInt(morphSeconds * currentSampleRate));
+    transportStateChanged(Starting);
+}
+
+void MainComponent::updateSnapshotBox()
+{
+    int selected = snapshotBox.getSelectedId();
+    snapshotBox.clear(juce::dontSendNotification);
+
+    // snapshots saved at another sample rate are listed with it, but can't be picked
+    for (int i = 0; i < library.getNumSnapshots(); ++i)
+    {
+        const SpectralSnapshot& snapshot = library.getSnapshot(i);
+        bool usable = snapshot.isForSampleRate(currentSampleRate);
+        snapshotBox.addItem(usable ? snapshot.getName()
+                                   : snapshot.getName() + " (" + juce::String(snapshot.getSampleRate() / 1000.0, 1) + " kHz)", i + 1);
+        snapshotBox.setItemEnabled(i + 1, usable);
+    }
+
+    if (selected > 0 && snapshotBox.isItemEnabled(selected))
+        snapshotBox.setSelectedId(selected, juce::dontSendNotification);
+}
+
 void MainComponent::transportStateChanged(TransportState newState)
 {
     if (newState == state) return;
@@ -140,214 +372,53 @@ void MainComponent::transportStateChanged(TransportState newState)
             transport.setPosition(0);
             break;
         case Starting:
-            if (oldState == Freezing) thawing = true;
+            if (oldState == Freezing) engine.thaw();
             stopButton.setEnabled(true);
             freezeButton.setEnabled(true);
             playButton.setEnabled(false);
-            transport.start();
+            if (!engine.isLiveInput()) transport.start();
             break;
         case Stopping:
             stopButton.setEnabled(false);
             freezeButton.setEnabled(false);
             playButton.setEnabled(true);
+            engine.cancel();
             transport.stop();
             break;
         case Freezing:
+            // the freeze (or recall) itself was sent by whoever got us here
             stopButton.setEnabled(true);
             playButton.setEnabled(true);
             freezeButton.setEnabled(false);
-            forecasting = true;
             break;
     }
+
+    // a snapshot is saved from a freeze and recalled over live playback, morphs start from a freeze
+    saveSnapshotButton.setEnabled(state == Freezing);
+    recallButton.setEnabled(state == Starting);
+    morphButton.setEnabled(state == Freezing);
+    morphOutButton.setEnabled(state == Freezing);
 }
 
 void MainComponent::getNextAudioBlock (const juce::AudioSourceChannelInfo& bufferToFill)
 {
-    auto* buffer = bufferToFill.buffer;
-    int numSamples = bufferToFill.numSamples;
-    
-    if (thawing) {
-        samplesBeforeFadeIn = getBufferDist(currentBufferReadIndex, currentBufferWriteIndex);
-        
-        // if we are on the last numSamples samples in our circle buffer
-        if (samplesBeforeFadeIn < numSamples) {
-            // set the read pos in the file based on remaining samples in the circular buffer
-            long long lastPos = transport.getNextReadPosition();
-            long long curPos = lastPos - samplesBeforeFadeIn;
-            transport.setNextReadPosition(curPos);
-
-            // set the new write pos to the circular buffer for the next time we read in more samples
-            currentBufferWriteIndex = getBufferPos(currentBufferWriteIndex, -samplesBeforeFadeIn);
-            
-            thawing = false;
-            justThawed = true;
-        }
-    }
-    
-    // if this is first iteration of forecasting
-    if (forecasting && forecast == 0) {
-        samplesBeforeFadeOut = (circularBufferSize / 2) % numSamples;
-    }
-    
-    // read next numsamples from the circular buffer
-    if (!forecasting && (state == Freezing || thawing)) {
-        
-        // for all audio channels, for each sample
-        for (int channel = 0; channel < buffer->getNumChannels(); ++channel)
-        {
-            for (int sample = 0; sample < numSamples; ++sample)
-            {
-                // read the first sample value out of the circular buffer, multiply by window val
-                int readIndex = (currentBufferReadIndex + sample) % circularBufferSize;
-                int windowIdx = getBufferDist((currentBufferWriteIndex + 1) % circularBufferSize, readIndex);
-                float windowVal = samples[windowIdx];
-                float sampleValue = circularBuffer.getSample(channel, readIndex) * windowVal;
-                
-                // read the second sample value out of the circular buffer, multiply by window val
-                int secondReadIndex = (readIndex + circularBufferSize / 2) % circularBufferSize;
-                float secondWindowVal = 1.0 - windowVal;
-                float secondSampleValue = circularBuffer.getSample(channel, secondReadIndex) * secondWindowVal;
-                
-                buffer->setSample(channel, sample, sampleValue + secondSampleValue);
-            }
-        }
-    
-        currentBufferReadIndex = (currentBufferReadIndex + numSamples) % circularBufferSize;
-    } 
-    else // read next numsamples from the file into the output buffer, write them to the circle buffer
-    {
-        // read from file, if no modifications are made later (i.e. forecasting or justThawed), sends audio to output buffer
-        transport.getNextAudioBlock(bufferToFill);
-
-        // write to circle buffer
-        for (int channel = 0; channel < buffer->getNumChannels(); ++channel)
-        {
-            for (int sample = 0; sample < numSamples; ++sample)
-            {
-                if (forecasting) {
-                    // fade out: multiply by the window, or 1 if we are before the window kicks in
-                    int fadeOutWindowIdx = circularBufferSize / 2 + forecast + sample - samplesBeforeFadeOut;
-                    float fadeOutWindowVal = (fadeOutWindowIdx >= circularBufferSize / 2) ? samples[fadeOutWindowIdx] : 1.0;
-                    float fadingOutSample = buffer->getSample(channel, sample) * fadeOutWindowVal;
-                    
-                    // fade in the first half of the circle buffer
-                    float fadeInWindowVal = 1.0 - fadeOutWindowVal;
-                    int fadeInSampleIdx = (currentBufferWriteIndex + 1 + circularBufferSize / 2 + sample) % circularBufferSize;
-                    float fadingInSample = circularBuffer.getSample(channel, fadeInSampleIdx) * fadeInWindowVal;
-                    
-                    buffer->setSample(channel, sample, fadingOutSample + fadingInSample);
-                }
-                
-                if (justThawed) {
-                    
-                    if (getBufferDist(currentBufferReadIndex, currentBufferWriteIndex) > circularBufferSize / 2)
-                    {
-                        justThawed = false;
-                    }
-                    
-                    // fade out the last half of the circle buffer
-                    int fadeOutSampleIdx = (currentBufferWriteIndex + circularBufferSize / 2 + sample) % circularBufferSize;
-                    int progressSinceThawing = getBufferDist(currentBufferReadIndex, currentBufferWriteIndex);
-                    int windowIdx = circularBufferSize / 2 - samplesBeforeFadeIn + progressSinceThawing;
-                    float windowVal = (windowIdx < circularBufferSize) ? samples[windowIdx] : 0.0;
-                    float fadeOutSampleVal = circularBuffer.getSample(channel, fadeOutSampleIdx) * windowVal;
-                    
-                    // fade in the next samples from the file
-                    float sampleVal = buffer->getSample(channel, sample) * (1 - windowVal);
-                    
-                    buffer->setSample(channel, sample, fadeOutSampleVal + sampleVal);
-                }
-                
-                int writeIndex = (currentBufferWriteIndex + sample) % circularBufferSize;
-                circularBuffer.setSample(channel, writeIndex, buffer->getSample(channel, sample));
-            }
-        }
-        
-        currentBufferWriteIndex = (currentBufferWriteIndex + numSamples) % circularBufferSize;
-        
-        // inc count of forecasted samples and check if its time to freeze
-        if (forecasting) {
-            forecast += numSamples;
-            if (forecast >= circularBufferSize / 2) {
-                
-                for (int channel = 0; channel < buffer->getNumChannels(); ++channel) {
-                    std::vector<float> fftBuffer(circularBufferSize * 2, 0.0f);
-
-                    // Step 1: Unwrap the circular buffer
-                    for (int i = 0; i < circularBufferSize; ++i)
-                    {
-                        int index = (currentBufferReadIndex + i) % circularBufferSize;
-                        fftBuffer[i] = circularBuffer.getSample(channel, index);
-                    }
-
-                    // Step 2: Perform the forward FFT
-                    fft.performRealOnlyForwardTransform(fftBuffer.data());
-
-                    // Step 3: Randomize the phase
-                    std::random_device rd;
-                    std::mt19937 gen(rd());
-                    std::uniform_real_distribution<float> dist(0.0f, 2.0f * juce::MathConstants<float>::pi);
-
-                    for (int i = 1; i < circularBufferSize / 2; ++i) // Skip DC and Nyquist frequencies
-                    {
-                        // Access real and imaginary parts (interleaved)
-                        float realPart = fftBuffer[2 * i];
-                        float imagPart = fftBuffer[2 * i + 1];
-                        
-                        // Compute magnitude
-                        float magnitude = std::sqrt(realPart * realPart + imagPart * imagPart);
-                        
-                        // Generate a random phase
-                        float randomPhase = dist(gen);
-                        
-                        // Update real and imaginary parts with randomized phase
-                        fftBuffer[2 * i] = magnitude * std::cos(randomPhase);
-                        fftBuffer[2 * i + 1] = magnitude * std::sin(randomPhase);
-                    }
-
-                    // Ensure symmetry for a real signal
-                    fftBuffer[1] = 0.0f; // Imaginary part of DC component
-                    fftBuffer[2 * (circularBufferSize / 2) + 1] = 0.0f; // Imaginary part of Nyquist frequency
-
-                    // Step 4: Perform the inverse FFT
-                    fft.performRealOnlyInverseTransform(fftBuffer.data());
-
-                    // Step 5: Normalize and rewrap the data back into the circular buffer
-                    for (int i = 0; i < circularBufferSize; ++i)
-                    {
-                        int index = (currentBufferReadIndex + i) % circularBufferSize;
-                        circularBuffer.setSample(channel, index, fftBuffer[i]);
-                    }
-                }
-                
-                // reset read idx to start of buffer, stop forecasting
-                currentBufferReadIndex = (currentBufferWriteIndex + 1) % circularBufferSize;
-                forecasting = false;
-                forecast = 0;
-                return;
-            }
-        }
-    }
-}
-
-// return the positive index at an arbitrary positive or negative offset
-// from an arbitrary start index
-int MainComponent::getBufferPos(int start, int offset) {
-    int absolutePos = start + offset;
-    int wrappedPos = absolutePos % circularBufferSize;
-    return (wrappedPos < 0) ? wrappedPos + circularBufferSize : wrappedPos;
-}
+    // a mono input (e.g. one instrument) feeds both sides, copied in place
+    if (engine.isLiveInput() && numInputChannels == 1)
+        for (int channel = 1; channel < bufferToFill.buffer->getNumChannels(); ++channel)
+            bufferToFill.buffer->copyFrom(channel, bufferToFill.startSample, *bufferToFill.buffer, 0,
+                                          bufferToFill.startSample, bufferToFill.numSamples);
 
-// distance in the forward direction from one circular buffer index to another
-int MainComponent::getBufferDist(int from, int to) {
-    int dist = to - from;
-    return (dist < 0) ? dist + circularBufferSize : dist;
+    engine.process(bufferToFill);
+    spectrumTap.push(bufferToFill);
 }
 
 void MainComponent::releaseResources()
 {
     // This will be called when the audio device stops, or when it is being
     // restarted due to a setting change.
+    engine.release();
+    transport.releaseResources();
+    telemetry.release();
 
     // For more details, see the help for AudioProcessor::releaseResources()
 }
@@ -358,13 +429,166 @@ void MainComponent::paint (juce::Graphics& g)
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
 
-    // You can add your drawing code here!
+    // a view tick only repaints the views, so the telemetry is skipped unless it was asked for too
+    if (g.clipRegionIntersects(telemetryArea))
+        paintTelemetry(g, telemetryArea);
+    paintWaveform(g, waveformArea);
+    paintSpectrum(g, spectrumArea);
+}
+
+void MainComponent::paintTelemetry(juce::Graphics& g, juce::Rectangle<int> area)
+{
+    Telemetry::Snapshot stats = telemetry.getSnapshot();
+
+    g.setColour(juce::Colours::white);
+    g.setFont(12.0f);
+    g.drawText("Deadline misses: " + juce::String(stats.deadlineMisses) + ", dropped: " + juce::String(stats.dropped),
+               area.removeFromTop(20), juce::Justification::centredLeft);
+
+    auto drawHistogram = [&g, &area] (const juce::String& name, const Telemetry::Histogram& histogram)
+    {
+        auto row = area.removeFromTop(juce::jmin(area.getHeight(), 70));
+        double mean = histogram.total > 0 ? histogram.sumMicros / histogram.total : 0.0;
+
+        g.setColour(juce::Colours::white);
+        g.drawText(name + ": " + juce::String(histogram.total) + ", mean " + juce::String(mean, 1)
+                   + " us, max " + juce::String(histogram.maxMicros, 1) + " us",
+                   row.removeFromTop(16), juce::Justification::centredLeft);
+
+        // one bar per power-of-two bucket, heights on a log scale so rare outliers still show
+        int peak = 1;
+        for (int count : histogram.counts) peak = juce::jmax(peak, count);
+
+        auto bars = row.reduced(0, 4);
+        float barWidth = bars.getWidth() / static_cast<float>(Telemetry::Histogram::numBuckets);
+        g.setColour(juce::Colours::lightblue);
+        for (int bucket = 0; bucket < Telemetry::Histogram::numBuckets; ++bucket)
+        {
+            if (histogram.counts[bucket] == 0) continue;
+            float height = bars.getHeight() * std::log1p(static_cast<float>(histogram.counts[bucket]))
+                           / std::log1p(static_cast<float>(peak));
+            g.fillRect(bars.getX() + bucket * barWidth, bars.getBottom() - height, juce::jmax(1.0f, barWidth - 1.0f), height);
+        }
+    };
+
+    for (int branch = 0; branch < Telemetry::numBranches; ++branch)
+        drawHistogram(Telemetry::getBranchName(static_cast<Telemetry::Branch>(branch)), stats.callbacks[branch]);
+    drawHistogram("transform", stats.transforms);
+    drawHistogram("freeze latency", stats.freezeLatency);
+}
+
+void MainComponent::paintWaveform(juce::Graphics& g, juce::Rectangle<int> area)
+{
+    g.setColour(juce::Colours::black);
+    g.fillRect(area);
+
+    juce::int64 length = overview.getLengthInSamples();
+    if (length == 0) return;
+
+    // a scrolling view around the playhead over a strip of the whole file
+    auto strip = area.removeFromBottom(16);
+    juce::int64 viewSamples = static_cast<juce::int64>(waveformSeconds * overview.getSampleRate());
+    juce::int64 playhead = static_cast<juce::int64>(transport.getCurrentPosition() * overview.getSampleRate());
+    juce::int64 viewStart = playhead - viewSamples / 2;
+
+    // one min/max per column from the pyramid, so the cost depends on the width, not the file
+    auto drawColumns = [this, &g] (juce::Rectangle<int> columns, juce::int64 start, juce::int64 numSamples)
+    {
+        float middle = columns.toFloat().getCentreY();
+        float halfHeight = columns.getHeight() * 0.5f;
+
+        for (int x = 0; x < columns.getWidth(); ++x)
+        {
+            juce::int64 from = start + numSamples * x / columns.getWidth();
+            juce::int64 to = start + numSamples * (x + 1) / columns.getWidth();
+            float low, high;
+            if (to <= 0 || from >= overview.getLengthInSamples() || ! overview.getRange(from, to, low, high)) continue;
+
+            g.drawVerticalLine(columns.getX() + x, middle - juce::jlimit(-1.0f, 1.0f, high) * halfHeight,
+                               middle - juce::jlimit(-1.0f, 1.0f, low) * halfHeight + 1.0f);
+        }
+    };
+
+    g.setColour(juce::Colours::lightblue);
+    drawColumns(area, viewStart, viewSamples);
+    drawColumns(strip, 0, length);
+
+    g.setColour(juce::Colours::white);
+    g.drawVerticalLine(area.getCentreX(), static_cast<float>(area.getY()), static_cast<float>(area.getBottom()));
+
+    // where the scrolling view sits within the file
+    float scale = strip.getWidth() / static_cast<float>(length);
+    g.setColour(juce::Colours::white.withAlpha(0.3f));
+    g.fillRect(juce::Rectangle<float>(strip.getX() + viewStart * scale, static_cast<float>(strip.getY()),
+                                      viewSamples * scale, static_cast<float>(strip.getHeight())));
+}
+
+void MainComponent::paintSpectrum(juce::Graphics& g, juce::Rectangle<int> area)
+{
+    g.setColour(juce::Colours::black);
+    g.fillRect(area);
+
+    // log frequency from 20 Hz to Nyquist, the loudest bin under each column
+    const float* levels = spectrumTap.getLevels();
+    float binsPerHz = SpectrumTap::fftSize / static_cast<float>(currentSampleRate);
+    float nyquist = static_cast<float>(currentSampleRate) * 0.5f;
+    auto bounds = area.toFloat();
+
+    juce::Path outline;
+    outline.startNewSubPath(bounds.getBottomLeft());
+
+    for (int x = 0; x < area.getWidth(); ++x)
+    {
+        float from = 20.0f * std::pow(nyquist / 20.0f, x / static_cast<float>(area.getWidth()));
+        float to = 20.0f * std::pow(nyquist / 20.0f, (x + 1) / static_cast<float>(area.getWidth()));
+        int firstBin = juce::jlimit(0, SpectrumTap::numBins - 1, static_cast<int>(from * binsPerHz));
+        int lastBin = juce::jlimit(firstBin, SpectrumTap::numBins - 1, static_cast<int>(to * binsPerHz));
+
+        float db = SpectrumTap::minimumDb;
+        for (int bin = firstBin; bin <= lastBin; ++bin)
+            db = juce::jmax(db, levels[bin]);
+
+        outline.lineTo(bounds.getX() + x, juce::jmap(db, SpectrumTap::minimumDb, 0.0f, bounds.getBottom(), bounds.getY()));
+    }
+
+    outline.lineTo(bounds.getBottomRight());
+    outline.closeSubPath();
+
+    g.setColour(juce::Colours::lightblue.withAlpha(0.6f));
+    g.fillPath(outline);
+}
+
+void MainComponent::timerCallback()
+{
+    spectrumTap.update();
+    repaint(waveformArea);
+    repaint(spectrumArea);
+
+    if (++timerTicks % telemetryTicks == 0)
+        repaint(telemetryArea);
 }
 
 void MainComponent::resized()
 {
-    openButton.setBounds(10, 10, getWidth() - 20, 30);
-    playButton.setBounds(10, 50, getWidth() - 20, 30);
-    stopButton.setBounds(10, 90, getWidth() - 20, 30);
-    freezeButton.setBounds(10, 130, getWidth() - 20, 30);
+    openButton.setBounds(10, 10, 180, 30);
+    playButton.setBounds(10, 50, 180, 30);
+    stopButton.setBounds(10, 90, 180, 30);
+    freezeButton.setBounds(10, 130, 180, 30);
+    instantButton.setBounds(10, 170, 180, 30);
+    stftButton.setBounds(10, 210, 180, 30);
+    layerButton.setBounds(10, 250, 180, 30);
+    liveButton.setBounds(10, 290, 180, 30);
+    latencyLabel.setBounds(10, 330, 180, 30);
+    lengthBox.setBounds(10, 370, 180, 30);
+    saveStatsButton.setBounds(10, 410, 180, 30);
+    saveSnapshotButton.setBounds(10, 450, 110, 30);
+    quantizeButton.setBounds(125, 450, 65, 30);
+    snapshotBox.setBounds(10, 490, 110, 30);
+    recallButton.setBounds(125, 490, 65, 30);
+    morphButton.setBounds(10, 530, 85, 30);
+    morphOutButton.setBounds(105, 530, 85, 30);
+
+    telemetryArea = getLocalBounds().withTrimmedLeft(200).withHeight(570).reduced(10);
+    waveformArea = juce::Rectangle<int>(10, 570, getWidth() - 20, 90);
+    spectrumArea = juce::Rectangle<int>(10, 670, getWidth() - 20, 70);
 }
@@ -3,13 +3,17 @@
 #include <JuceHeader.h>
 #include <deque>
 #include <juce_dsp/juce_dsp.h>
+#include "FreezeEngine.h"
+#include "SpectrumTap.h"
+#include "WaveformOverview.h"
 
 //==============================================================================
 /*
     This component lives inside our window, and this is where you should put all
     your controls and content.
 */
-class MainComponent  : public juce::AudioAppComponent
+class MainComponent  : public juce::AudioAppComponent,
+                       private juce::Timer
 {
 public:
     //==============================================================================
@@ -41,32 +45,69 @@ private:
     void playButtonClicked();
     void stopButtonClicked();
     void freezeButtonClicked();
+    void liveButtonClicked();
+    void lengthChanged();
+    void saveStatsClicked();
+    void saveSnapshotClicked();
+    void recallClicked();
+    void morphClicked();
+    void morphOutClicked();
+    void updateSnapshotBox();
+    void timerCallback() override;
+    void paintTelemetry(juce::Graphics& g, juce::Rectangle<int> area);
+    void paintWaveform(juce::Graphics& g, juce::Rectangle<int> area);
+    void paintSpectrum(juce::Graphics& g, juce::Rectangle<int> area);
     void transportStateChanged(TransportState newState);
-    int getBufferPos(int start, int offset);
-    int getBufferDist(int from, int to);
+    std::unique_ptr<juce::PositionableAudioSource> createPlaySource(const juce::File& file, double& sampleRate);
     
     juce::AudioFormatManager formatManager;
-    std::unique_ptr<juce::AudioFormatReaderSource> playSource;
+    juce::TimeSliceThread readAheadThread;
+    std::unique_ptr<juce::PositionableAudioSource> playSource;
     juce::AudioTransportSource transport;
     
     juce::TextButton openButton;
     juce::TextButton playButton;
     juce::TextButton stopButton;
     juce::TextButton freezeButton;
+    juce::ToggleButton instantButton;
+    juce::ToggleButton stftButton;
+    juce::ToggleButton layerButton;
+    juce::ToggleButton liveButton;
+    juce::Label latencyLabel;
+    juce::ComboBox lengthBox;
+    juce::TextButton saveStatsButton;
+    juce::TextButton saveSnapshotButton;
+    juce::ToggleButton quantizeButton;
+    juce::ComboBox snapshotBox;
+    juce::TextButton recallButton;
+    juce::TextButton morphButton;
+    juce::TextButton morphOutButton;
     
-    juce::AudioSampleBuffer circularBuffer;
-    juce::dsp::FFT fft;
-    int circularBufferSize;
-    int currentBufferReadIndex;
-    int currentBufferWriteIndex;
-    int forecast;
-    bool thawing;
-    bool justThawed;
-    int samplesBeforeFadeIn;
-    bool forecasting;
+    // about 1.5 s at 44.1 kHz of decoded audio kept ahead of the playhead
+    static constexpr int readAheadSamples = 65536;
+    // compressed files up to this long are decoded into memory when opened
+    static constexpr double maxDecodedSeconds = 300.0;
+    // how long a morph takes to glide from one end to the other
+    static constexpr double morphSeconds = 4.0;
+    // the stretch of the file the scrolling waveform shows around the playhead
+    static constexpr double waveformSeconds = 8.0;
+    // the views redraw on every tick, the telemetry on every telemetryTicks-th
+    static constexpr int viewRefreshHz = 30;
+    static constexpr int telemetryTicks = 8;
+    
+    Telemetry telemetry;
+    WaveformOverview overview;
+    SpectrumTap spectrumTap;
+    juce::Rectangle<int> telemetryArea;
+    juce::Rectangle<int> waveformArea;
+    juce::Rectangle<int> spectrumArea;
+    int timerTicks;
+    // declared before the engine so snapshots stay mapped until it is gone
+    SnapshotLibrary library;
+    FreezeEngine engine;
     int freezeSamples;
-    float *samples;
-    int samplesBeforeFadeOut;
+    int numInputChannels;
+    double currentSampleRate;
     //==============================================================================
     // Your private member variables go here...
 
@@ -0,0 +1,73 @@
+#include "SpectralCache.h"
+
+//==============================================================================
+SpectralCache::WindowTable::WindowTable(int newSize, juce::dsp::WindowingFunction<float>::WindowingMethod method)
+    : size(newSize)
+{
+    window.allocate(size, true);
+    complement.allocate(size, true);
+
+    // juce error: noramlisation param is inverted?
+    juce::dsp::WindowingFunction<float>::fillWindowingTables(window, size, method, false);
+    juce::FloatVectorOperations::fill(complement, 1.0f, size);
+    juce::FloatVectorOperations::subtract(complement, window, size);
+}
+
+//==============================================================================
+SpectralCache::FftPlan::Ptr SpectralCache::acquireFft(int order)
+{
+    const juce::ScopedLock sl(lock);
+
+    // a plan whose only reference is ours is free to hand out again
+    auto range = plans.equal_range(order);
+    for (auto it = range.first; it != range.second; ++it)
+        if (it->second->getReferenceCount() == 1)
+            return it->second;
+
+    purgeIdle();
+    FftPlan::Ptr plan = new FftPlan(order);
+    plans.insert({ order, plan });
+    return plan;
+}
+
+SpectralCache::WindowTable::Ptr SpectralCache::getWindow(int size, juce::dsp::WindowingFunction<float>::WindowingMethod method)
+{
+    const juce::ScopedLock sl(lock);
+
+    auto key = std::make_pair(size, static_cast<int>(method));
+    auto found = windows.find(key);
+    if (found != windows.end())
+        return found->second;
+
+    purgeIdle();
+    WindowTable::Ptr table = new WindowTable(size, method);
+    windows[key] = table;
+    return table;
+}
+
+juce::ThreadPool& SpectralCache::getHelperPool()
+{
+    const juce::ScopedLock sl(lock);
+
+    if (helperPool == nullptr)
+        helperPool = std::make_unique<juce::ThreadPool>(juce::jmax(1, juce::SystemStats::getNumCpus() - 1));
+
+    return *helperPool;
+}
+
+void SpectralCache::purgeIdle()
+{
+    int idle = 0;
+    for (auto& entry : plans)
+        if (entry.second->getReferenceCount() == 1) ++idle;
+    for (auto& entry : windows)
+        if (entry.second->getReferenceCount() == 1) ++idle;
+
+    if (idle < maxIdleEntries) return;
+
+    // nothing records which entries were used last, so clear out every idle one
+    for (auto it = plans.begin(); it != plans.end();)
+        it = it->second->getReferenceCount() == 1 ? plans.erase(it) : std::next(it);
+    for (auto it = windows.begin(); it != windows.end();)
+        it = it->second->getReferenceCount() == 1 ? windows.erase(it) : std::next(it);
+}
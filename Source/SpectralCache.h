@@ -0,0 +1,81 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <map>
+#include <juce_dsp/juce_dsp.h>
+
+//==============================================================================
+/*
+    Size-keyed pool of FFT plans and window tables, shared by every engine in
+    the process through a juce::SharedResourcePointer, along with the helper
+    threads that transform the channels of a freeze in parallel.
+
+    Building a large FFT or window is slow and allocates, so once one exists it
+    is kept for the next user of the same size: switching sizes back and forth
+    or restarting the device only costs a lookup. Window tables are read-only
+    and shared between all users. An FFT object may serialise its callers, so a
+    plan is only ever leased to one user at a time and goes back to the pool
+    when the last pointer to it is dropped. A plan comes with scratch space for
+    one transform of its size, so an engine that leases its plan only for the
+    length of a transform holds no FFT memory at all while it is idle.
+
+    Lookups lock and may allocate: call them from prepare() or a background
+    thread, never from the audio thread.
+*/
+class SpectralCache
+{
+public:
+    //==============================================================================
+    struct FftPlan  : public juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<FftPlan>;
+
+        explicit FftPlan(int order)
+            : fft(order),
+              buffer(static_cast<size_t>(2 << order), 0.0f),
+              magnitudes(static_cast<size_t>((1 << order) / 2 + 1), 0.0f)
+        {
+        }
+
+        juce::dsp::FFT fft;
+        // room for a real-only transform in place, and for the magnitudes of its bins
+        std::vector<float> buffer;
+        std::vector<float> magnitudes;
+    };
+
+    struct WindowTable  : public juce::ReferenceCountedObject
+    {
+        using Ptr = juce::ReferenceCountedObjectPtr<WindowTable>;
+
+        WindowTable(int size, juce::dsp::WindowingFunction<float>::WindowingMethod method);
+
+        // the window and 1 - window, so every crossfade is a pair of multiply-adds
+        juce::HeapBlock<float> window;
+        juce::HeapBlock<float> complement;
+        int size;
+    };
+
+    //==============================================================================
+    SpectralCache() = default;
+
+    // an FFT of 2^order points that nobody else holds
+    FftPlan::Ptr acquireFft(int order);
+    // a shared table of `size` points, not normalised
+    WindowTable::Ptr getWindow(int size, juce::dsp::WindowingFunction<float>::WindowingMethod method);
+    // one pool of helper threads for every engine, a thread per core but one;
+    // a job may have to wait its turn behind another engine's
+    juce::ThreadPool& getHelperPool();
+
+private:
+    // entries only the cache still holds are dropped once there are more than this
+    static constexpr int maxIdleEntries = 16;
+
+    void purgeIdle();
+
+    juce::CriticalSection lock;
+    std::multimap<int, FftPlan::Ptr> plans;
+    std::map<std::pair<int, int>, WindowTable::Ptr> windows;
+    std::unique_ptr<juce::ThreadPool> helperPool;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralCache)
+};
@@ -0,0 +1,335 @@
+#include "SpectralMorph.h"
+#include "FreezeKernels.h"
+#include "SpectralUtils.h"
+
+//==============================================================================
+SpectralMorph::SpectralMorph()
+    : phaseSeed(SpectralUtils::makeRandomSeed()),
+      frameCount(0),
+      frameSize(0),
+      hopSize(0),
+      numBins(0),
+      sharedPhase(false),
+      stage(Stopped),
+      fromRing(nullptr),
+      toRing(nullptr),
+      liveRing(nullptr),
+      liveEnd(0),
+      slicesPerChannel(0),
+      slicesPerFrame(0),
+      measureSlices(0),
+      nextSlice(0),
+      credit(0),
+      frameSkip(0),
+      frameProgress(0.0f),
+      position(0.0f),
+      progressPerHop(0.0f),
+      accumulatorIndex(0),
+      samplesUntilHop(0)
+{
+}
+
+void SpectralMorph::prepare(int numChannels, int newFrameSize, int newHopSize,
+                            juce::dsp::WindowingFunction<float>::WindowingMethod windowType)
+{
+    jassert(juce::isPowerOfTwo(newFrameSize) && newFrameSize % newHopSize == 0);
+
+    frameSize = newFrameSize;
+    hopSize = newHopSize;
+    numBins = SpectralUtils::getNumBins(frameSize);
+    fft = nullptr;
+    fft = cache->acquireFft(static_cast<int>(std::log2(frameSize)));
+    fftBuffer.assign(frameSize * 2, 0.0f);
+    scratch.assign(frameSize, 0.0f);
+    fromMagnitudes.setSize(numChannels, numBins);
+    toMagnitudes.setSize(numChannels, numBins);
+    // a frame is laid down up to a hop before it starts playing, so the
+    // accumulator holds a hop more than a frame
+    accumulator.setSize(numChannels, frameSize + hopSize);
+    frameCount = 0;
+
+    // the same level calibration as StftFreeze: random-phase frames overlap in power
+    analysisWindow = cache->getWindow(frameSize, windowType);
+    const float* window = analysisWindow->window;
+
+    float meanSquare = 0.0f;
+    for (int i = 0; i < frameSize; ++i)
+        meanSquare += window[i] * window[i];
+    meanSquare /= static_cast<float>(frameSize);
+
+    float gain = 1.0f / (meanSquare * std::sqrt(static_cast<float>(frameSize) / static_cast<float>(hopSize)));
+    synthesisWindow.resize(frameSize);
+    juce::FloatVectorOperations::multiply(synthesisWindow.data(), window, gain, frameSize);
+
+    stop();
+}
+
+//==============================================================================
+void SpectralMorph::start(const juce::AudioSampleBuffer& from, const juce::AudioSampleBuffer* to, int morphHops)
+{
+    jassert(from.getNumSamples() >= frameSize && (to == nullptr || to->getNumSamples() >= frameSize));
+
+    fromRing = &from;
+    toRing = to;
+    fromMagnitudes.clear();
+    toMagnitudes.clear();
+    accumulator.clear();
+    accumulatorIndex = 0;
+    samplesUntilHop = 0;
+
+    // per channel: the live target's analysis, the bins a slice at a time, the inverse FFT
+    int binSlices = juce::jmax(1, (frameSize / 2) / binsPerSlice);
+    slicesPerChannel = (toRing == nullptr ? 1 : 0) + binSlices + 1;
+    slicesPerFrame = fromMagnitudes.getNumChannels() * slicesPerChannel;
+    // every frame of each measured end, then one slice to average them
+    measureSlices = fromMagnitudes.getNumChannels() * framesPerEnd * (toRing == nullptr ? 1 : 2) + 1;
+
+    stage = Measuring;
+    nextSlice = 0;
+    credit = 0;
+    position = 0.0f;
+    progressPerHop = 1.0f / static_cast<float>(juce::jmax(1, morphHops));
+}
+
+void SpectralMorph::setLiveTarget(const juce::AudioSampleBuffer& ring, int endIndex)
+{
+    jassert(ring.getNumSamples() >= frameSize);
+
+    liveRing = &ring;
+    liveEnd = endIndex;
+}
+
+void SpectralMorph::stop()
+{
+    stage = Stopped;
+    fromRing = nullptr;
+    toRing = nullptr;
+    liveRing = nullptr;
+    position = 0.0f;
+}
+
+bool SpectralMorph::prepareAhead(int numSamples)
+{
+    if (stage == Stopped || stage == Playing) return stage == Playing;
+
+    credit += static_cast<juce::int64>(numSamples) * slicesPerFrame;
+
+    while (credit >= hopSize && stage != Playing)
+    {
+        credit -= hopSize;
+
+        if (stage == Measuring)
+        {
+            measureSlice(nextSlice++);
+            if (nextSlice == measureSlices)
+            {
+                // prime the overlap-add as StftFreeze::capture() does: the frames that
+                // would have started one, two, ... hops ago first, the one starting now last
+                stage = Priming;
+                beginFrame(frameSize - hopSize);
+            }
+            continue;
+        }
+
+        frameSlice(nextSlice++);
+        if (nextSlice < slicesPerFrame) continue;
+
+        if (frameSkip > 0)
+        {
+            beginFrame(frameSkip - hopSize);
+            continue;
+        }
+
+        stage = Playing;
+        credit = 0;
+        samplesUntilHop = hopSize;
+        beginFrame(0);
+    }
+
+    return stage == Playing;
+}
+
+void SpectralMorph::addTo(juce::AudioSampleBuffer& buffer, int startSample, int numSamples, const float* gains)
+{
+    if (stage != Playing) return;
+
+    int numChannels = juce::jmin(buffer.getNumChannels(), accumulator.getNumChannels());
+    int size = accumulator.getNumSamples();
+    int done = 0;
+
+    while (done < numSamples)
+    {
+        if (samplesUntilHop == 0)
+        {
+            // the credit pays for the whole frame by now, this only catches rounding
+            while (nextSlice < slicesPerFrame)
+                frameSlice(nextSlice++);
+
+            credit = 0;
+            samplesUntilHop = hopSize;
+            beginFrame(0);
+        }
+
+        int span = juce::jmin(numSamples - done, samplesUntilHop);
+
+        // build the next frame a span's worth further before playing the span
+        credit += static_cast<juce::int64>(span) * slicesPerFrame;
+        while (credit >= hopSize && nextSlice < slicesPerFrame)
+        {
+            credit -= hopSize;
+            frameSlice(nextSlice++);
+        }
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* out = buffer.getWritePointer(channel, startSample + done);
+            float* accum = accumulator.getWritePointer(channel);
+
+            if (gains != nullptr)
+                FreezeKernels::addFromRingWithMultiply(out, accum, size, accumulatorIndex, gains + done, span);
+            else
+                FreezeKernels::addFromRing(out, accum, size, accumulatorIndex, span);
+
+            FreezeKernels::clearRing(accum, size, accumulatorIndex, span);
+        }
+
+        accumulatorIndex = FreezeKernels::wrap(accumulatorIndex, span, size);
+        samplesUntilHop -= span;
+        done += span;
+    }
+}
+
+//==============================================================================
+void SpectralMorph::measureSlice(int slice)
+{
+    int numChannels = fromMagnitudes.getNumChannels();
+    int perEnd = numChannels * framesPerEnd;
+
+    if (slice == measureSlices - 1)
+    {
+        // mean power of the frames, back to magnitudes
+        for (auto* magnitudes : { &fromMagnitudes, &toMagnitudes })
+        {
+            if (magnitudes == &toMagnitudes && toRing == nullptr) continue;
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                float* bins = magnitudes->getWritePointer(channel);
+                for (int bin = 0; bin < numBins; ++bin)
+                    bins[bin] = std::sqrt(bins[bin] / static_cast<float>(framesPerEnd));
+            }
+        }
+        return;
+    }
+
+    const juce::AudioSampleBuffer& ring = slice < perEnd ? *fromRing : *toRing;
+    juce::AudioSampleBuffer& magnitudes = slice < perEnd ? fromMagnitudes : toMagnitudes;
+    int frame = (slice % perEnd) / numChannels;
+    int channel = slice % numChannels;
+
+    analyseFrame(ring, channel, frame * (ring.getNumSamples() / framesPerEnd));
+    SpectralUtils::computePowers(fftBuffer.data(), scratch.data(), frameSize);
+    juce::FloatVectorOperations::add(magnitudes.getWritePointer(channel), scratch.data(), numBins);
+}
+
+void SpectralMorph::frameSlice(int slice)
+{
+    int channel = slice / slicesPerChannel;
+    int step = slice % slicesPerChannel;
+
+    if (toRing == nullptr)
+    {
+        // the live target is whatever the latest frame of the ring holds
+        if (step == 0)
+        {
+            if (liveRing == nullptr) return;
+
+            int ringSize = liveRing->getNumSamples();
+            analyseFrame(*liveRing, channel, (liveEnd - frameSize + ringSize) % ringSize);
+            SpectralUtils::computeMagnitudes(fftBuffer.data(), toMagnitudes.getWritePointer(channel), frameSize);
+            return;
+        }
+        --step;
+    }
+
+    int binSlices = slicesPerChannel - 1 - (toRing == nullptr ? 1 : 0);
+    if (step == binSlices)
+    {
+        synthesiseFrame(channel);
+        return;
+    }
+
+    // the last slice takes the Nyquist bin along with its share
+    int firstBin = step * binsPerSlice;
+    int count = step == binSlices - 1 ? numBins - firstBin : binsPerSlice;
+    interpolateBins(channel, firstBin, count);
+}
+
+void SpectralMorph::analyseFrame(const juce::AudioSampleBuffer& ring, int channel, int frameStart)
+{
+    float* data = fftBuffer.data();
+    int ringSize = ring.getNumSamples();
+
+    FreezeKernels::copyFromRing(data, ring.getReadPointer(juce::jmin(channel, ring.getNumChannels() - 1)),
+                                ringSize, frameStart, frameSize);
+    juce::FloatVectorOperations::multiply(data, analysisWindow->window, frameSize);
+    juce::FloatVectorOperations::clear(data + frameSize, frameSize);
+
+    fft->fft.performRealOnlyForwardTransform(data);
+}
+
+void SpectralMorph::beginFrame(int skip)
+{
+    frameSkip = skip;
+    frameProgress = stage == Playing ? juce::jmin(1.0f, position + progressPerHop) : 0.0f;
+    nextSlice = 0;
+    ++frameCount;
+}
+
+void SpectralMorph::interpolateBins(int channel, int firstBin, int count)
+{
+    float* data = fftBuffer.data();
+    float* magnitudes = scratch.data();
+
+    juce::FloatVectorOperations::copyWithMultiply(magnitudes, fromMagnitudes.getReadPointer(channel, firstBin),
+                                                  1.0f - frameProgress, count);
+    juce::FloatVectorOperations::addWithMultiply(magnitudes, toMagnitudes.getReadPointer(channel, firstBin),
+                                                 frameProgress, count);
+
+    // phases are keyed by frame and channel, so a slice draws just its own bins;
+    // with shared phase every channel draws the first one's
+    int first = juce::jmax(firstBin, 1);
+    int end = juce::jmin(firstBin + count, numBins - 1);
+    SpectralUtils::writePhasors(data, magnitudes + (first - firstBin), first, end - first,
+                                SpectralUtils::getPhaseKey(phaseSeed, frameCount, sharedPhase ? 0 : channel));
+
+    // DC and Nyquist have no phase to randomise
+    if (firstBin == 0)
+    {
+        data[0] = magnitudes[0];
+        data[1] = 0.0f;
+    }
+
+    if (firstBin + count == numBins)
+    {
+        data[2 * (numBins - 1)] = magnitudes[count - 1];
+        data[2 * (numBins - 1) + 1] = 0.0f;
+    }
+}
+
+void SpectralMorph::synthesiseFrame(int channel)
+{
+    float* data = fftBuffer.data();
+    int size = accumulator.getNumSamples();
+    int length = frameSize - frameSkip;
+
+    fft->fft.performRealOnlyInverseTransform(data);
+
+    // window and overlap-add at the next hop, dropping the first `frameSkip` samples
+    juce::FloatVectorOperations::multiply(scratch.data(), data + frameSkip, synthesisWindow.data() + frameSkip, length);
+    FreezeKernels::addToRing(accumulator.getWritePointer(channel), size,
+                             FreezeKernels::wrap(accumulatorIndex, samplesUntilHop, size), scratch.data(), length);
+
+    if (channel == accumulator.getNumChannels() - 1)
+        position = frameProgress;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <juce_dsp/juce_dsp.h>
+#include "SpectralCache.h"
+
+//==============================================================================
+/*
+    Glides between two magnitude spectra by streaming short random-phase frames,
+    like StftFreeze, with each frame's magnitudes interpolated a little further
+    from one end towards the other.
+
+    The ends are measured from audio: a frozen loop is analysed over a few frames
+    spread across it, and a live target is re-analysed from the latest frame of
+    its ring every hop. None of the work happens in one go. Measuring the ends,
+    interpolating and phasing a slice of bins, and one inverse FFT each count as
+    a slice, and every sample played pays for the same share of the slices a hop
+    needs. The next frame is built while the current hop plays, so however long
+    the morph and however blocks fall against hops, each callback does about the
+    same amount of work.
+*/
+class SpectralMorph
+{
+public:
+    //==============================================================================
+    SpectralMorph();
+
+    // frameSize must be a power of two and a multiple of hopSize
+    void prepare(int numChannels, int frameSize, int hopSize,
+                 juce::dsp::WindowingFunction<float>::WindowingMethod windowType);
+
+    //==============================================================================
+    // audio thread: start measuring `from` and, unless it is null, `to`; both are
+    // read over the following callbacks so must stay put until isReady(). a null
+    // `to` glides towards whatever is written into the ring given to setLiveTarget().
+    // the glide itself takes morphHops hops once the stream is playing
+    void start(const juce::AudioSampleBuffer& from, const juce::AudioSampleBuffer* to, int morphHops);
+    // audio thread: where a live target is being written, `endIndex` just past the newest sample
+    void setLiveTarget(const juce::AudioSampleBuffer& ring, int endIndex);
+    void stop();
+
+    // audio thread: spend numSamples' share of slices on measuring the ends and the
+    // first frames. nothing is played yet; returns true once addTo() can start
+    bool prepareAhead(int numSamples);
+    bool isReady() const { return stage == Playing; }
+    // true once the frames being played have reached the far end
+    bool hasArrived() const { return position >= 1.0f; }
+
+    // audio thread: add the next numSamples of the glide into `buffer`, each sample
+    // scaled by `gains` (or unscaled when gains is null)
+    void addTo(juce::AudioSampleBuffer& buffer, int startSample, int numSamples, const float* gains);
+
+    // same random phases for every channel of a frame (see SpectralWorker::setSharedPhase)
+    void setSharedPhase(bool shouldShare) { sharedPhase = shouldShare; }
+    // the seed frames draw their phases from (see SpectralWorker::setPhaseSeed)
+    void setPhaseSeed(juce::uint64 seed) { phaseSeed = seed; }
+
+    int getHopSize() const { return hopSize; }
+
+private:
+    enum Stage
+    {
+        Stopped,
+        Measuring,
+        Priming,
+        Playing
+    };
+
+    // frames of each end averaged together, spread evenly across its ring
+    static constexpr int framesPerEnd = 4;
+    // bins interpolated and given a phase per slice
+    static constexpr int binsPerSlice = 256;
+
+    void measureSlice(int slice);
+    void frameSlice(int slice);
+    void analyseFrame(const juce::AudioSampleBuffer& ring, int channel, int frameStart);
+    void beginFrame(int skip);
+    void interpolateBins(int channel, int firstBin, int numBins);
+    void synthesiseFrame(int channel);
+
+    juce::SharedResourcePointer<SpectralCache> cache;
+    SpectralCache::FftPlan::Ptr fft;
+    SpectralCache::WindowTable::Ptr analysisWindow;
+    std::vector<float> synthesisWindow;
+    std::vector<float> fftBuffer;
+    std::vector<float> scratch;
+    juce::AudioSampleBuffer fromMagnitudes;
+    juce::AudioSampleBuffer toMagnitudes;
+    juce::AudioSampleBuffer accumulator;
+    juce::uint64 phaseSeed;
+    juce::uint64 frameCount;
+    int frameSize;
+    int hopSize;
+    int numBins;
+    bool sharedPhase;
+
+    Stage stage;
+    const juce::AudioSampleBuffer* fromRing;
+    const juce::AudioSampleBuffer* toRing;
+    const juce::AudioSampleBuffer* liveRing;
+    int liveEnd;
+
+    // each sample earns slicesPerFrame of credit and each slice costs hopSize,
+    // so the slices of one frame are paid for over exactly one hop
+    int slicesPerChannel;
+    int slicesPerFrame;
+    int measureSlices;
+    int nextSlice;
+    juce::int64 credit;
+
+    // the frame being built lands `frameSkip` samples into itself at the next hop
+    int frameSkip;
+    float frameProgress;
+    float position;
+    float progressPerHop;
+    int accumulatorIndex;
+    int samplesUntilHop;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralMorph)
+};
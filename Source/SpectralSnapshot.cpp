@@ -0,0 +1,160 @@
+#include "SpectralSnapshot.h"
+#include "SpectralUtils.h"
+#include <set>
+
+//==============================================================================
+SpectralSnapshot::SpectralSnapshot(const juce::File& snapshotFile, std::unique_ptr<juce::MemoryMappedFile> newMapping)
+    : file(snapshotFile),
+      mapping(std::move(newMapping)),
+      peaks(nullptr),
+      data(nullptr),
+      numChannels(0),
+      bufferSize(0),
+      fftSize(0),
+      numBins(0),
+      sampleRate(0.0),
+      quantized(false)
+{
+}
+
+std::unique_ptr<SpectralSnapshot> SpectralSnapshot::load(const juce::File& file)
+{
+    auto mapping = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readOnly);
+    auto* bytes = static_cast<const char*>(mapping->getData());
+    auto size = mapping->getSize();
+    if (bytes == nullptr || size < headerSize) return nullptr;
+
+    auto readInt = [bytes] (int offset) { return juce::ByteOrder::littleEndianInt(bytes + offset); };
+    if (readInt(0) != magic || readInt(4) != version) return nullptr;
+
+    float rate;
+    std::memcpy(&rate, bytes + 24, sizeof(rate));
+
+    std::unique_ptr<SpectralSnapshot> snapshot(new SpectralSnapshot(file, std::move(mapping)));
+    snapshot->quantized = (readInt(8) & 1) != 0;
+    snapshot->numChannels = static_cast<int>(readInt(12));
+    snapshot->bufferSize = static_cast<int>(readInt(16));
+    snapshot->fftSize = static_cast<int>(readInt(20));
+    snapshot->sampleRate = rate;
+
+    // the sizes have to agree with each other and with the file before anything is trusted
+    bool valid = snapshot->numChannels > 0 && snapshot->bufferSize > 0 && snapshot->sampleRate > 0.0
+                 && snapshot->fftSize == juce::nextPowerOfTwo(snapshot->bufferSize);
+    if (! valid) return nullptr;
+
+    snapshot->numBins = SpectralUtils::getNumBins(snapshot->fftSize);
+    size_t valueSize = snapshot->quantized ? sizeof(juce::uint16) : sizeof(float);
+    size_t expected = headerSize + sizeof(float) * static_cast<size_t>(snapshot->numChannels)
+                      + valueSize * static_cast<size_t>(snapshot->numChannels) * static_cast<size_t>(snapshot->numBins);
+    if (size < expected) return nullptr;
+
+    snapshot->peaks = reinterpret_cast<const float*>(bytes + headerSize);
+    snapshot->data = bytes + headerSize + sizeof(float) * static_cast<size_t>(snapshot->numChannels);
+    return snapshot;
+}
+
+bool SpectralSnapshot::write(const juce::File& file, const juce::AudioSampleBuffer& magnitudes,
+                             int bufferSize, double sampleRate, bool quantize)
+{
+    int channels = magnitudes.getNumChannels();
+    int fftSize = juce::nextPowerOfTwo(bufferSize);
+    int bins = SpectralUtils::getNumBins(fftSize);
+    jassert(magnitudes.getNumSamples() == bins);
+
+    file.deleteFile();
+    juce::FileOutputStream out(file);
+    if (! out.openedOk()) return false;
+
+    out.writeInt(static_cast<int>(magic));
+    out.writeInt(static_cast<int>(version));
+    out.writeInt(quantize ? 1 : 0);
+    out.writeInt(channels);
+    out.writeInt(bufferSize);
+    out.writeInt(fftSize);
+    out.writeFloat(static_cast<float>(sampleRate));
+    out.writeInt(0);
+
+    std::vector<float> channelPeaks;
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        channelPeaks.push_back(juce::FloatVectorOperations::findMaximum(magnitudes.getReadPointer(channel), bins));
+        out.writeFloat(channelPeaks.back());
+    }
+
+    for (int channel = 0; channel < channels; ++channel)
+    {
+        const float* values = magnitudes.getReadPointer(channel);
+
+        if (! quantize)
+        {
+            out.write(values, sizeof(float) * static_cast<size_t>(bins));
+            continue;
+        }
+
+        // 0 is silence, 1 to 65535 step evenly through the 120 dB below the peak
+        float peakDb = juce::Decibels::gainToDecibels(channelPeaks[static_cast<size_t>(channel)], -1000.0f);
+        std::vector<juce::uint16> steps(static_cast<size_t>(bins));
+        for (int bin = 0; bin < bins; ++bin)
+        {
+            float belowPeak = peakDb - juce::Decibels::gainToDecibels(values[bin], -1000.0f);
+            steps[static_cast<size_t>(bin)] = belowPeak >= quantizedRangeDb ? 0
+                : static_cast<juce::uint16>(1 + juce::roundToInt((1.0f - belowPeak / quantizedRangeDb) * 65534.0f));
+        }
+        out.write(steps.data(), sizeof(juce::uint16) * steps.size());
+    }
+
+    out.flush();
+    return ! out.getStatus().failed();
+}
+
+const float* SpectralSnapshot::getMagnitudes(int channel, float* scratch) const
+{
+    if (! quantized)
+        return reinterpret_cast<const float*>(data) + static_cast<size_t>(channel) * static_cast<size_t>(numBins);
+
+    auto* steps = reinterpret_cast<const juce::uint16*>(data) + static_cast<size_t>(channel) * static_cast<size_t>(numBins);
+
+    // peak * 10^(dB / 20) with dB running from -range to 0, as one exp per bin
+    float peak = peaks[channel];
+    float dbPerStep = quantizedRangeDb / 65534.0f;
+    float nepersPerDb = std::log(10.0f) / 20.0f;
+    for (int bin = 0; bin < numBins; ++bin)
+        scratch[bin] = steps[bin] == 0 ? 0.0f
+            : peak * std::exp(((steps[bin] - 1) * dbPerStep - quantizedRangeDb) * nepersPerDb);
+
+    return scratch;
+}
+
+//==============================================================================
+SnapshotLibrary::SnapshotLibrary(const juce::File& libraryDirectory)
+    : directory(libraryDirectory)
+{
+}
+
+void SnapshotLibrary::scan()
+{
+    std::set<juce::String> loaded;
+    for (auto& snapshot : snapshots)
+        loaded.insert(snapshot->getName());
+
+    for (auto& file : directory.findChildFiles(juce::File::findFiles, false, juce::String("*") + SpectralSnapshot::fileExtension))
+        if (loaded.count(file.getFileNameWithoutExtension()) == 0)
+            if (auto snapshot = SpectralSnapshot::load(file))
+                snapshots.push_back(std::move(snapshot));
+}
+
+int SnapshotLibrary::add(const juce::String& name, const juce::AudioSampleBuffer& magnitudes,
+                         int bufferSize, double sampleRate, bool quantize)
+{
+    if (! directory.createDirectory()) return -1;
+
+    // a loaded snapshot's file is never rewritten under its mapping, a clash gets a number instead
+    juce::File file = directory.getNonexistentChildFile(name, SpectralSnapshot::fileExtension, true);
+    if (! SpectralSnapshot::write(file, magnitudes, bufferSize, sampleRate, quantize)) return -1;
+
+    auto snapshot = SpectralSnapshot::load(file);
+    if (snapshot == nullptr) return -1;
+
+    snapshots.push_back(std::move(snapshot));
+    return getNumSnapshots() - 1;
+}
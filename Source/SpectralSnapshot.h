@@ -0,0 +1,94 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+//==============================================================================
+/*
+    A frozen spectrum saved to disk: the half-spectrum magnitudes of every
+    channel of one freeze, enough to resynthesise it without the audio.
+
+    The file is a 32 byte header, one peak level per channel and then the
+    magnitudes, channel after channel, either as 32-bit floats or as 16-bit
+    steps on a 120 dB log scale below each channel's peak. Everything is
+    little-endian and 4-byte aligned, so a loaded snapshot is just a read-only
+    mapping of the file: float magnitudes are used in place and nothing is
+    read from disk until a recall touches it.
+*/
+class SpectralSnapshot
+{
+public:
+    //==============================================================================
+    // maps `file` and checks its header; null if it isn't a readable snapshot
+    static std::unique_ptr<SpectralSnapshot> load(const juce::File& file);
+
+    // `magnitudes` holds one channel per channel of getNumBins(fftSize) bins,
+    // for a freeze of bufferSize samples transformed at the next power of two
+    static bool write(const juce::File& file, const juce::AudioSampleBuffer& magnitudes,
+                      int bufferSize, double sampleRate, bool quantize);
+
+    static constexpr const char* fileExtension = ".afsnap";
+
+    //==============================================================================
+    juce::String getName() const { return file.getFileNameWithoutExtension(); }
+    int getNumChannels() const { return numChannels; }
+    int getBufferSize() const { return bufferSize; }
+    int getFftSize() const { return fftSize; }
+    double getSampleRate() const { return sampleRate; }
+    // the bins are spaced for the rate the snapshot was saved at; recalled at any
+    // other it would play back transposed, so only a matching rate may recall it
+    bool isForSampleRate(double rate) const { return std::abs(sampleRate - rate) < 0.5; }
+    bool isQuantized() const { return quantized; }
+
+    // any thread: the magnitudes of `channel`, pointing straight into the mapping
+    // when they are stored as floats, otherwise decoded into `scratch`
+    const float* getMagnitudes(int channel, float* scratch) const;
+
+private:
+    SpectralSnapshot(const juce::File& file, std::unique_ptr<juce::MemoryMappedFile> mapping);
+
+    static constexpr juce::uint32 magic = 0x4e534641; // "AFSN"
+    static constexpr juce::uint32 version = 1;
+    static constexpr int headerSize = 32;
+    static constexpr float quantizedRangeDb = 120.0f;
+
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+    const float* peaks;
+    const char* data;
+    int numChannels;
+    int bufferSize;
+    int fftSize;
+    int numBins;
+    double sampleRate;
+    bool quantized;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralSnapshot)
+};
+
+//==============================================================================
+/*
+    Every snapshot in a directory, each kept mapped for the library's lifetime
+    so the engine can recall one without it ever being unmapped underneath.
+*/
+class SnapshotLibrary
+{
+public:
+    explicit SnapshotLibrary(const juce::File& directory);
+
+    // maps any snapshot files not already loaded; only their headers are read
+    void scan();
+
+    // saves a new snapshot (numbered if the name is taken), loads it and returns
+    // its index, or -1 if it couldn't be written
+    int add(const juce::String& name, const juce::AudioSampleBuffer& magnitudes,
+            int bufferSize, double sampleRate, bool quantize);
+
+    int getNumSnapshots() const { return static_cast<int>(snapshots.size()); }
+    const SpectralSnapshot& getSnapshot(int index) const { return *snapshots[static_cast<size_t>(index)]; }
+
+private:
+    juce::File directory;
+    std::vector<std::unique_ptr<SpectralSnapshot>> snapshots;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SnapshotLibrary)
+};
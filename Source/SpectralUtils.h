@@ -0,0 +1,157 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <random>
+
+//==============================================================================
+/*
+    Helpers shared by everything that works on juce::dsp::FFT's real-only
+    layout: bins 0 .. fftSize / 2 stored as interleaved (real, imag) pairs.
+*/
+namespace SpectralUtils
+{
+    inline int getNumBins(int fftSize) { return fftSize / 2 + 1; }
+
+    // magnitudes of bins 0 .. fftSize / 2
+    inline void computeMagnitudes(const float* fftData, float* magnitudes, int fftSize)
+    {
+        for (int i = 0; i < getNumBins(fftSize); ++i)
+        {
+            float realPart = fftData[2 * i];
+            float imagPart = fftData[2 * i + 1];
+            magnitudes[i] = std::sqrt(realPart * realPart + imagPart * imagPart);
+        }
+    }
+
+    // squared magnitudes of bins 0 .. fftSize / 2
+    inline void computePowers(const float* fftData, float* powers, int fftSize)
+    {
+        for (int i = 0; i < getNumBins(fftSize); ++i)
+        {
+            float realPart = fftData[2 * i];
+            float imagPart = fftData[2 * i + 1];
+            powers[i] = realPart * realPart + imagPart * imagPart;
+        }
+    }
+
+    //==============================================================================
+    // random phases are counter-based: a bin's phase is a hash of its index and a
+    // 32-bit key, so a draw carries no generator state, any range of bins can be
+    // drawn on its own and the result never depends on which thread drew it.
+    // a key comes from a seed, a draw counter and a stream (e.g. the channel),
+    // and the same three always give the same phases
+
+    // bins per block of the phase kernel; a fixed trip count keeps it vectorizable
+    static constexpr int phaseBlockSize = 64;
+
+    // a seed for when none was asked for
+    inline juce::uint64 makeRandomSeed()
+    {
+        std::random_device device;
+        return (static_cast<juce::uint64>(device()) << 32) | device();
+    }
+
+    inline juce::uint32 getPhaseKey(juce::uint64 seed, juce::uint64 draw, int stream)
+    {
+        // splitmix64's finaliser over the three, folded to 32 bits
+        juce::uint64 x = seed + draw * 0x9e3779b97f4a7c15ull + static_cast<juce::uint64>(stream) * 0xd1b54a32d192ed03ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return static_cast<juce::uint32>(x ^ (x >> 32));
+    }
+
+    // unit phasors at uniformly random angles for bins firstBin .. firstBin + phaseBlockSize - 1
+    inline void generatePhasorBlock(float* cosines, float* sines, int firstBin, juce::uint32 key)
+    {
+        for (int i = 0; i < phaseBlockSize; ++i)
+        {
+            // lowbias32 hash of the bin's counter
+            juce::uint32 x = static_cast<juce::uint32>(firstBin + i) * 0x9e3779b9u + key;
+            x ^= x >> 16;
+            x *= 0x7feb352du;
+            x ^= x >> 15;
+            x *= 0x846ca68bu;
+            x ^= x >> 16;
+
+            // the top two bits pick a quarter turn, the other 30 an angle within +-pi/4 of it
+            float angle = (static_cast<float>(static_cast<int>(x & 0x3fffffffu)) * (1.0f / 1073741824.0f) - 0.5f)
+                          * juce::MathConstants<float>::halfPi;
+            // Taylor polynomials, within 3e-7 of sin and cos over that range
+            float a2 = angle * angle;
+            float sine = angle * (1.0f + a2 * (-1.0f / 6.0f + a2 * (1.0f / 120.0f + a2 * (-1.0f / 5040.0f))));
+            float cosine = 1.0f + a2 * (-0.5f + a2 * (1.0f / 24.0f + a2 * (-1.0f / 720.0f + a2 * (1.0f / 40320.0f))));
+
+            // rotate by the quarter turns without branching: an odd count swaps
+            // (cos, sin) for (-sin, cos), two more negate both
+            float swap = static_cast<float>(static_cast<int>((x >> 30) & 1u));
+            float sign = 1.0f - 2.0f * static_cast<float>(static_cast<int>(x >> 31));
+            cosines[i] = sign * (cosine - swap * (sine + cosine));
+            sines[i] = sign * (sine + swap * (cosine - sine));
+        }
+    }
+
+    // spectrum[2 * bin], spectrum[2 * bin + 1] = magnitudes[bin - firstBin] times
+    // the bin's unit phasor, for numBins bins from firstBin; plain unit phasors
+    // (a phase field) when magnitudes is null
+    inline void writePhasors(float* spectrum, const float* magnitudes, int firstBin, int numBins, juce::uint32 key)
+    {
+        float cosines[phaseBlockSize];
+        float sines[phaseBlockSize];
+
+        for (int done = 0; done < numBins; done += phaseBlockSize)
+        {
+            int count = juce::jmin(phaseBlockSize, numBins - done);
+            float* out = spectrum + 2 * (firstBin + done);
+            generatePhasorBlock(cosines, sines, firstBin + done, key);
+
+            if (magnitudes == nullptr)
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    out[2 * i] = cosines[i];
+                    out[2 * i + 1] = sines[i];
+                }
+                continue;
+            }
+
+            const float* blockMagnitudes = magnitudes + done;
+            for (int i = 0; i < count; ++i)
+            {
+                out[2 * i] = blockMagnitudes[i] * cosines[i];
+                out[2 * i + 1] = blockMagnitudes[i] * sines[i];
+            }
+        }
+    }
+
+    // replace every bin between DC and Nyquist with the given magnitude at a
+    // uniformly random phase. DC and Nyquist keep their real parts and lose any
+    // imaginary part, as they must for a real signal
+    inline void randomisePhase(float* fftData, const float* magnitudes, int fftSize, juce::uint32 key)
+    {
+        writePhasors(fftData, magnitudes + 1, 1, fftSize / 2 - 1, key);
+
+        fftData[1] = 0.0f;
+        fftData[2 * (fftSize / 2) + 1] = 0.0f;
+    }
+
+    // one set of random phases, stored as interleaved (cos, sin) pairs in the same
+    // layout as the spectrum, to be shared by several channels with applyPhaseField()
+    inline void generatePhaseField(float* field, int fftSize, juce::uint32 key)
+    {
+        writePhasors(field, nullptr, 1, fftSize / 2 - 1, key);
+    }
+
+    // randomisePhase() with the phases taken from a shared field
+    inline void applyPhaseField(float* fftData, const float* magnitudes, const float* field, int fftSize)
+    {
+        for (int i = 1; i < fftSize / 2; ++i)
+        {
+            fftData[2 * i] = magnitudes[i] * field[2 * i];
+            fftData[2 * i + 1] = magnitudes[i] * field[2 * i + 1];
+        }
+
+        fftData[1] = 0.0f;
+        fftData[2 * (fftSize / 2) + 1] = 0.0f;
+    }
+}
@@ -0,0 +1,563 @@
+#include "SpectralWorker.h"
+#include "SpectralUtils.h"
+
+#if JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#elif JUCE_WINDOWS
+ #include <windows.h>
+#else
+ #include <cerrno>
+ #include <semaphore.h>
+#endif
+
+//==============================================================================
+// the platform's own semaphore: posting one is an atomic increment, plus a call
+// into the kernel to wake the worker if it is asleep, and never waits on a lock
+#if JUCE_MAC || JUCE_IOS
+struct SpectralWorker::Wakeup::Semaphore
+{
+    Semaphore() : handle(dispatch_semaphore_create(0)) {}
+    ~Semaphore() { dispatch_release(handle); }
+    void post() { dispatch_semaphore_signal(handle); }
+    void wait() { dispatch_semaphore_wait(handle, DISPATCH_TIME_FOREVER); }
+
+    dispatch_semaphore_t handle;
+};
+#elif JUCE_WINDOWS
+struct SpectralWorker::Wakeup::Semaphore
+{
+    Semaphore() : handle(CreateSemaphore(nullptr, 0, LONG_MAX, nullptr)) {}
+    ~Semaphore() { CloseHandle(handle); }
+    void post() { ReleaseSemaphore(handle, 1, nullptr); }
+    void wait() { WaitForSingleObject(handle, INFINITE); }
+
+    HANDLE handle;
+};
+#else
+struct SpectralWorker::Wakeup::Semaphore
+{
+    Semaphore() { sem_init(&handle, 0, 0); }
+    ~Semaphore() { sem_destroy(&handle); }
+    void post() { sem_post(&handle); }
+    void wait() { while (sem_wait(&handle) != 0 && errno == EINTR) {} }
+
+    sem_t handle;
+};
+#endif
+
+SpectralWorker::Wakeup::Wakeup()
+    : semaphore(std::make_unique<Semaphore>()),
+      pending(false)
+{
+}
+
+SpectralWorker::Wakeup::~Wakeup() = default;
+
+void SpectralWorker::Wakeup::post()
+{
+    if (! pending.exchange(true))
+        semaphore->post();
+}
+
+void SpectralWorker::Wakeup::wait()
+{
+    semaphore->wait();
+    // the exchange pairs with post()'s, so whatever was posted is visible from here on
+    pending.exchange(false);
+}
+
+//==============================================================================
+SpectralWorker::SpectralWorker()
+    : juce::Thread("Spectral worker"),
+      stage(Idle),
+      loopPrepared(false),
+      rollingPrepared(false),
+      phaseSeed(SpectralUtils::makeRandomSeed()),
+      drawSeed(0),
+      drawCount(0),
+      window(nullptr),
+      complement(nullptr),
+      numChannels(0),
+      bufferSize(0),
+      fftSize(0),
+      fftOrder(0),
+      snapshotStart(0),
+      loopRequested(false),
+      recallSnapshot(nullptr),
+      synchronous(false),
+      lastTransformTicks(0),
+      rollingEnabled(false),
+      historyFifo(1),
+      publishedReady(false),
+      historyWriteIndex(0),
+      historyFilled(0),
+      samplesSinceAnalysis(0),
+      rollingHop(0),
+      pool(nullptr),
+      batchInput(nullptr),
+      batchRing(nullptr),
+      batchLoop(nullptr),
+      batchInputStart(0),
+      batchOutputStart(0),
+      nextChannel(0),
+      channelsDone(0),
+      sharedPhase(false),
+      batchSharedPhase(false),
+      batchDraw(0),
+      batchRecall(nullptr),
+      batchCapture(false),
+      magnitudesReady(false)
+{
+}
+
+SpectralWorker::~SpectralWorker()
+{
+    release();
+}
+
+//==============================================================================
+void SpectralWorker::prepare(int newNumChannels, int newBufferSize, const float* newWindow,
+                             const float* newComplement, bool useThread)
+{
+    release();
+
+    numChannels = newNumChannels;
+    bufferSize = newBufferSize;
+    window = newWindow;
+    complement = newComplement;
+    snapshot.setSize(numChannels, bufferSize);
+    result.setSize(numChannels, bufferSize);
+    snapshot.clear();
+    result.clear();
+    snapshotStart = 0;
+
+    // the loop and rolling storage wait until something asks for them
+    loopResult.setSize(0, 0);
+    loopPrepared = false;
+
+    // each channel leases its own FFT while it is transformed, as an FFT object may
+    // serialise its callers; lease one per channel now so the first freeze finds them built
+    fftSize = juce::nextPowerOfTwo(bufferSize);
+    fftOrder = static_cast<int>(std::log2(fftSize));
+    {
+        std::vector<SpectralCache::FftPlan::Ptr> plans;
+        for (int channel = 0; channel < numChannels; ++channel)
+            plans.push_back(cache->acquireFft(fftOrder));
+    }
+    phaseField.assign(fftSize + 2, 0.0f);
+    drawSeed = phaseSeed;
+    drawCount = 0;
+    capturingMagnitudes.setSize(numChannels, SpectralUtils::getNumBins(fftSize));
+    frozenMagnitudes.setSize(numChannels, SpectralUtils::getNumBins(fftSize));
+    magnitudesReady = false;
+
+    // the worker itself takes a share of the channels, so it needs one helper fewer
+    pool = &cache->getHelperPool();
+    int numHelpers = juce::jmin(numChannels - 1, pool->getNumThreads());
+    jobs.clear();
+    for (int i = 0; i < numHelpers; ++i)
+        jobs.push_back(std::make_unique<ChannelJob>(*this));
+    stage = Idle;
+    synchronous = ! useThread;
+
+    // re-freezing every eighth of a buffer keeps the rolling loop at most ~90 ms
+    // behind at the default size while costing a fraction of a core
+    rollingEnabled = false;
+    for (auto* buffer : { &fifoBuffer, &history, &rollingRing, &rollingLoop, &publishedRing, &publishedLoop })
+        buffer->setSize(0, 0);
+    rollingPrepared = false;
+    publishedReady = false;
+    historyWriteIndex = 0;
+    historyFilled = 0;
+    samplesSinceAnalysis = 0;
+    rollingHop = bufferSize / 8;
+
+    if (! synchronous)
+        startThread();
+}
+
+void SpectralWorker::prepareLoop()
+{
+    if (loopPrepared) return;
+
+    // nothing swaps loopResult until a loop is requested, which only happens after this
+    loopResult.setSize(numChannels, bufferSize);
+    loopResult.clear();
+    loopPrepared = true;
+}
+
+void SpectralWorker::release()
+{
+    // wake the thread so it notices it should exit
+    signalThreadShouldExit();
+    wakeup.post();
+    stopThread(2000);
+    stage = Idle;
+    historyFifo.reset();
+
+    // the pool is shared, so only this worker's jobs come out of it
+    for (auto& job : jobs)
+        pool->removeJob(job.get(), true, 2000);
+}
+
+//==============================================================================
+bool SpectralWorker::postSnapshot(const juce::AudioSampleBuffer& ring, int start, bool withLoop)
+{
+    // a stale Ready result that nobody collected can simply be overwritten
+    int current = stage.load();
+    if (current == Pending || current == Busy) return false;
+
+    jassert(ring.getNumSamples() == bufferSize);
+    int firstSpan = bufferSize - start;
+
+    // unwrap the ring, oldest sample first
+    for (int channel = 0; channel < snapshot.getNumChannels(); ++channel)
+    {
+        const float* src = ring.getReadPointer(channel);
+        float* dest = snapshot.getWritePointer(channel);
+        juce::FloatVectorOperations::copy(dest, src + start, firstSpan);
+        juce::FloatVectorOperations::copy(dest + firstSpan, src, start);
+    }
+
+    snapshotStart = start;
+    loopRequested = withLoop;
+    recallSnapshot = nullptr;
+
+    if (synchronous)
+    {
+        transformSnapshot();
+        stage = Ready;
+        return true;
+    }
+
+    stage = Pending;
+    wakeup.post();
+    return true;
+}
+
+bool SpectralWorker::postRecall(const SpectralSnapshot& recalled)
+{
+    int current = stage.load();
+    if (current == Pending || current == Busy) return false;
+
+    jassert(recalled.getBufferSize() == bufferSize);
+    snapshotStart = 0;
+    loopRequested = true;
+    recallSnapshot = &recalled;
+
+    if (synchronous)
+    {
+        transformSnapshot();
+        stage = Ready;
+        return true;
+    }
+
+    stage = Pending;
+    wakeup.post();
+    return true;
+}
+
+bool SpectralWorker::getFrozenMagnitudes(juce::AudioSampleBuffer& magnitudes)
+{
+    const juce::SpinLock::ScopedLockType lock(magnitudesLock);
+    if (! magnitudesReady) return false;
+
+    magnitudes.makeCopyOf(frozenMagnitudes);
+    return true;
+}
+
+bool SpectralWorker::collectResult(juce::AudioSampleBuffer& ring, juce::AudioSampleBuffer& loop)
+{
+    if (stage.load() != Ready) return false;
+
+    // both buffers were sized in prepare(), so this only trades pointers
+    std::swap(ring, result);
+    if (loopRequested)
+        std::swap(loop, loopResult);
+    stage = Idle;
+    return true;
+}
+
+//==============================================================================
+void SpectralWorker::setRollingAnalysis(bool shouldAnalyse)
+{
+    if (shouldAnalyse)
+        prepareRolling();
+
+    rollingEnabled = shouldAnalyse;
+    wakeup.post();
+}
+
+void SpectralWorker::prepareRolling()
+{
+    if (rollingPrepared || bufferSize == 0) return;
+
+    // neither the audio thread nor the worker touches these before rollingEnabled is set
+    historyFifo.setTotalSize(bufferSize);
+    fifoBuffer.setSize(numChannels, bufferSize);
+    history.setSize(numChannels, bufferSize);
+    rollingRing.setSize(numChannels, bufferSize);
+    rollingLoop.setSize(numChannels, bufferSize);
+    publishedRing.setSize(numChannels, bufferSize);
+    publishedLoop.setSize(numChannels, bufferSize);
+    history.clear();
+    rollingPrepared = true;
+}
+
+void SpectralWorker::pushHistory(const juce::AudioSampleBuffer& source, int startSample, int numSamples)
+{
+    if (! rollingEnabled.load()) return;
+
+    int start1, size1, start2, size2;
+    historyFifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+
+    int numChannels = juce::jmin(source.getNumChannels(), fifoBuffer.getNumChannels());
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        if (size1 > 0) fifoBuffer.copyFrom(channel, start1, source, channel, startSample, size1);
+        if (size2 > 0) fifoBuffer.copyFrom(channel, start2, source, channel, startSample + size1, size2);
+    }
+
+    historyFifo.finishedWrite(size1 + size2);
+    if (! synchronous)
+        wakeup.post();
+
+    if (synchronous)
+    {
+        drainHistory();
+        if (historyFilled == bufferSize && samplesSinceAnalysis >= rollingHop)
+            analyseHistory();
+    }
+}
+
+bool SpectralWorker::takeRollingResult(juce::AudioSampleBuffer& ring, juce::AudioSampleBuffer& loop)
+{
+    // the worker only holds the lock for two pointer swaps; if we miss it, try next block
+    const juce::SpinLock::ScopedTryLockType lock(publishLock);
+    if (! lock.isLocked() || ! publishedReady) return false;
+
+    std::swap(ring, publishedRing);
+    std::swap(loop, publishedLoop);
+    publishedReady = false;
+    return true;
+}
+
+//==============================================================================
+void SpectralWorker::run()
+{
+    while (! threadShouldExit())
+    {
+        // a posted snapshot always goes first, it is what the user is waiting on
+        int expected = Pending;
+        if (stage.compare_exchange_strong(expected, Busy))
+        {
+            transformSnapshot();
+            stage = Ready;
+            continue;
+        }
+
+        if (rollingEnabled.load())
+        {
+            drainHistory();
+            if (historyFilled == bufferSize && samplesSinceAnalysis >= rollingHop)
+            {
+                analyseHistory();
+                continue;
+            }
+        }
+
+        // sleeps until a snapshot, a recall or more history is posted, or until release()
+        wakeup.wait();
+    }
+}
+
+void SpectralWorker::transformSnapshot()
+{
+    auto start = juce::Time::getHighResolutionTicks();
+    bool capture = recallSnapshot == nullptr;
+    transformChannels(snapshot, 0, result, snapshotStart, loopRequested ? &loopResult : nullptr, recallSnapshot, capture);
+    lastTransformTicks = juce::Time::getHighResolutionTicks() - start;
+
+    // the message thread only holds the lock to copy; if it has it, this freeze isn't kept
+    if (capture)
+    {
+        const juce::SpinLock::ScopedTryLockType lock(magnitudesLock);
+        if (lock.isLocked())
+        {
+            std::swap(capturingMagnitudes, frozenMagnitudes);
+            magnitudesReady = true;
+        }
+    }
+}
+
+void SpectralWorker::drainHistory()
+{
+    int start1, size1, start2, size2;
+    historyFifo.prepareToRead(historyFifo.getNumReady(), start1, size1, start2, size2);
+
+    for (auto [start, size] : { std::make_pair(start1, size1), std::make_pair(start2, size2) })
+    {
+        // copy into the history ring, which may itself wrap
+        while (size > 0)
+        {
+            int span = juce::jmin(size, bufferSize - historyWriteIndex);
+            for (int channel = 0; channel < history.getNumChannels(); ++channel)
+                history.copyFrom(channel, historyWriteIndex, fifoBuffer, channel, start, span);
+
+            historyWriteIndex = (historyWriteIndex + span) % bufferSize;
+            historyFilled = juce::jmin(bufferSize, historyFilled + span);
+            samplesSinceAnalysis += span;
+            start += span;
+            size -= span;
+        }
+    }
+
+    historyFifo.finishedRead(size1 + size2);
+}
+
+void SpectralWorker::analyseHistory()
+{
+    samplesSinceAnalysis = 0;
+
+    // history is unwrapped from its oldest sample, which is the next one to be overwritten
+    transformChannels(history, historyWriteIndex, rollingRing, 0, &rollingLoop, nullptr, false);
+
+    const juce::SpinLock::ScopedLockType lock(publishLock);
+    std::swap(rollingRing, publishedRing);
+    std::swap(rollingLoop, publishedLoop);
+    publishedReady = true;
+}
+
+void SpectralWorker::transformChannels(const juce::AudioSampleBuffer& input, int inputStart, juce::AudioSampleBuffer& ringOut,
+                                       int outputStart, juce::AudioSampleBuffer* loopOut,
+                                       const SpectralSnapshot* recalled, bool captureMagnitudes)
+{
+    batchInput = &input;
+    batchRing = &ringOut;
+    batchLoop = loopOut;
+    batchInputStart = inputStart;
+    batchOutputStart = outputStart;
+    batchRecall = recalled;
+    batchCapture = captureMagnitudes;
+    batchSharedPhase = sharedPhase;
+    // every batch is a fresh draw, and each channel's phases depend only on the
+    // draw and the channel, never on which thread claims it
+    batchDraw = drawCount++;
+    if (batchSharedPhase)
+        SpectralUtils::generatePhaseField(phaseField.data(), fftSize, SpectralUtils::getPhaseKey(drawSeed, batchDraw, 0));
+
+    batchDone.reset();
+    channelsDone = 0;
+    nextChannel = 0;
+
+    // a helper still queued from last time will pick this batch up when it runs
+    for (auto& job : jobs)
+        if (! pool->contains(job.get()))
+            pool->addJob(job.get(), false);
+
+    claimChannels();
+
+    if (channelsDone.load() < numChannels)
+        batchDone.wait(-1);
+}
+
+void SpectralWorker::claimChannels()
+{
+    for (int channel = nextChannel++; channel < numChannels; channel = nextChannel++)
+    {
+        // leased for this channel only, so engines that aren't freezing hold no FFT memory
+        SpectralCache::FftPlan::Ptr plan = cache->acquireFft(fftOrder);
+        float* ringOut = batchRing->getWritePointer(channel);
+        float* loopOut = batchLoop != nullptr ? batchLoop->getWritePointer(channel) : nullptr;
+        juce::uint32 phaseKey = SpectralUtils::getPhaseKey(drawSeed, batchDraw, channel);
+
+        if (batchRecall != nullptr)
+        {
+            // a snapshot with fewer channels repeats its last one
+            int stored = juce::jmin(channel, batchRecall->getNumChannels() - 1);
+            const float* magnitudes = batchRecall->getMagnitudes(stored, plan->magnitudes.data());
+
+            // there is no forward transform to leave DC and Nyquist behind, so set them here
+            plan->buffer[0] = magnitudes[0];
+            plan->buffer[static_cast<size_t>(fftSize)] = magnitudes[fftSize / 2];
+            resynthesise(*plan, phaseKey, magnitudes, ringOut, batchOutputStart, loopOut);
+        }
+        else
+        {
+            transform(*plan, phaseKey, batchInput->getReadPointer(channel), batchInputStart, ringOut, batchOutputStart, loopOut);
+            if (batchCapture)
+                juce::FloatVectorOperations::copy(capturingMagnitudes.getWritePointer(channel), plan->magnitudes.data(),
+                                                  capturingMagnitudes.getNumSamples());
+        }
+
+        plan = nullptr;
+        if (++channelsDone == numChannels)
+            batchDone.signal();
+    }
+}
+
+SpectralWorker::ChannelJob::ChannelJob(SpectralWorker& newOwner)
+    : juce::ThreadPoolJob("Spectral channel"),
+      owner(newOwner)
+{
+}
+
+juce::ThreadPoolJob::JobStatus SpectralWorker::ChannelJob::runJob()
+{
+    owner.claimChannels();
+    return jobHasFinished;
+}
+
+void SpectralWorker::transform(SpectralCache::FftPlan& plan, juce::uint32 phaseKey, const float* input, int inputStart,
+                               float* ringOut, int outputStart, float* loopOut)
+{
+    float* data = plan.buffer.data();
+
+    // Step 1: Unwrap the input, zeroing the rest of the space the FFT works in
+    int firstSpan = bufferSize - inputStart;
+    juce::FloatVectorOperations::copy(data, input + inputStart, firstSpan);
+    juce::FloatVectorOperations::copy(data + firstSpan, input, inputStart);
+    juce::FloatVectorOperations::clear(data + bufferSize, fftSize * 2 - bufferSize);
+
+    // Step 2: Perform the forward FFT
+    plan.fft.performRealOnlyForwardTransform(data);
+
+    // Step 3: Measure each bin's magnitude; from here on a recalled snapshot is the same
+    SpectralUtils::computeMagnitudes(data, plan.magnitudes.data(), fftSize);
+    resynthesise(plan, phaseKey, plan.magnitudes.data(), ringOut, outputStart, loopOut);
+}
+
+void SpectralWorker::resynthesise(SpectralCache::FftPlan& plan, juce::uint32 phaseKey, const float* magnitudes,
+                                  float* ringOut, int outputStart, float* loopOut)
+{
+    float* data = plan.buffer.data();
+
+    // Step 4: Randomize the phase, keeping each bin's magnitude
+    if (batchSharedPhase)
+        SpectralUtils::applyPhaseField(data, magnitudes, phaseField.data(), fftSize);
+    else
+        SpectralUtils::randomisePhase(data, magnitudes, fftSize, phaseKey);
+
+    // Step 5: Perform the inverse FFT
+    plan.fft.performRealOnlyInverseTransform(data);
+
+    // a zero-padded input's energy is spread over all fftSize samples of the
+    // result, so scale back up to the input's level before keeping bufferSize of them
+    if (fftSize != bufferSize)
+        juce::FloatVectorOperations::multiply(data, std::sqrt(static_cast<float>(fftSize) / static_cast<float>(bufferSize)), bufferSize);
+
+    // Step 6: Rewrap the data at the requested position
+    int firstSpan = bufferSize - outputStart;
+    juce::FloatVectorOperations::copy(ringOut + outputStart, data, firstSpan);
+    juce::FloatVectorOperations::copy(ringOut, data + firstSpan, outputStart);
+
+    // Step 7: Optionally bake the two-tap crossfade the engine would do per block
+    // into one full cycle: loop[k] = y[k] * window[k] + y[k + size / 2] * complement[k]
+    if (loopOut != nullptr)
+    {
+        int half = bufferSize / 2;
+        juce::FloatVectorOperations::multiply(loopOut, data, window, bufferSize);
+        juce::FloatVectorOperations::addWithMultiply(loopOut, data + half, complement, half);
+        juce::FloatVectorOperations::addWithMultiply(loopOut + half, data, complement + half, half);
+    }
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <juce_dsp/juce_dsp.h>
+#include "SpectralCache.h"
+#include "SpectralSnapshot.h"
+
+//==============================================================================
+/*
+    Background thread that turns a forecast snapshot into a frozen loop.
+
+    The audio thread copies the circular buffer (unwrapped, oldest sample first)
+    into the worker with postSnapshot(), the worker does the forward FFT, phase
+    randomization and inverse FFT into preallocated storage, and the audio thread
+    picks the result up with collectResult(), which swaps it into the ring.
+    When asked, the worker also renders one full cycle of the crossfaded loop so
+    frozen playback becomes a straight copy. Neither side ever allocates or waits
+    on the other once prepare() has run. prepare() only sizes what every freeze
+    needs; the rendered loop's buffer and the rolling analysis below are
+    allocated from the message thread when first asked for.
+
+    For instant freezes the audio thread can also stream everything it plays into
+    the worker with pushHistory(). The worker keeps its own copy of the last
+    buffer's worth of audio and re-freezes it every hop, so a frozen loop of the
+    recent past is always waiting in takeRollingResult().
+
+    Channels are transformed in parallel: the worker and the helper threads
+    shared by every engine in the process each claim the next untransformed
+    channel until none are left, so a 16 channel freeze takes roughly the time
+    of a few channels in series. Each channel leases an FFT plan and its scratch
+    space from the cache only while it is being transformed, so an idle worker
+    holds nothing but buffers the size of its freeze.
+
+    The buffer size need not be a power of two: the transform zero-pads to the
+    next one up and keeps the first bufferSize samples of the resynthesis.
+
+    The magnitudes of each posted snapshot are kept so a freeze can be saved,
+    and a saved SpectralSnapshot can be posted in place of the ring, skipping
+    straight to the phase randomisation and inverse transform.
+*/
+class SpectralWorker  : private juce::Thread
+{
+public:
+    //==============================================================================
+    SpectralWorker();
+    ~SpectralWorker() override;
+
+    //==============================================================================
+    // allocates the snapshot storage and starts the thread; call before the audio thread runs.
+    // `window` and `complement` are the engine's crossfade tables, used to render the loop.
+    // without `useThread` postSnapshot() does the transform inline (offline rendering)
+    void prepare(int numChannels, int bufferSize, const float* window, const float* complement,
+                 bool useThread = true);
+    // message thread: allocates the buffer a rendered loop comes back in. call it before
+    // the first snapshot posted with a loop, or recall, since prepare()
+    void prepareLoop();
+    // stops the thread, any snapshot in flight is dropped
+    void release();
+
+    //==============================================================================
+    // audio thread: hand off the ring unwrapped from `start`, returns false if the
+    // worker is still busy with an earlier snapshot (try again next block)
+    bool postSnapshot(const juce::AudioSampleBuffer& ring, int start, bool withLoop);
+    // audio thread: whether collectResult() would hand back a result right now
+    bool isResultReady() const { return stage.load() == Ready; }
+    // audio thread: if the frozen loop is ready, swap it into `ring` and return true.
+    // if the snapshot asked for a rendered loop it is swapped into `loop`, starting at `start`
+    bool collectResult(juce::AudioSampleBuffer& ring, juce::AudioSampleBuffer& loop);
+    // audio thread: resynthesise a saved spectrum of this buffer size instead of a
+    // snapshot of the ring. it comes back through collectResult() unwrapped (oldest
+    // sample at index 0) with a rendered loop. false while the worker is busy;
+    // `recalled` must stay loaded until the result has been collected
+    bool postRecall(const SpectralSnapshot& recalled);
+    // message thread: copy out the magnitudes of the last snapshot transformed,
+    // one channel per channel; false if nothing has been frozen since prepare()
+    bool getFrozenMagnitudes(juce::AudioSampleBuffer& magnitudes);
+    // audio thread, after collectResult(): how long the collected transform took
+    juce::int64 getLastTransformTicks() const { return lastTransformTicks; }
+
+    //==============================================================================
+    // message thread: turns the rolling analysis of pushed history on or off; the
+    // first time it is turned on since prepare() it allocates its history
+    void setRollingAnalysis(bool shouldAnalyse);
+    // give every channel the same random phases, which keeps the level
+    // differences between channels as a coherent image and draws far fewer phases
+    void setSharedPhase(bool shouldShare) { sharedPhase = shouldShare; }
+    // the seed every freeze's phases are drawn from, counting draws from zero
+    // again; applied at the next prepare(), until then a random one is used
+    void setPhaseSeed(juce::uint64 seed) { phaseSeed = seed; }
+    // audio thread: feed the samples just played; dropped if the worker falls behind
+    void pushHistory(const juce::AudioSampleBuffer& source, int startSample, int numSamples);
+    // audio thread: swap the latest rolling freeze into `ring` and `loop`, both
+    // unwrapped (oldest sample at index 0). false if none is ready yet
+    bool takeRollingResult(juce::AudioSampleBuffer& ring, juce::AudioSampleBuffer& loop);
+
+private:
+    // wakes the worker from the audio thread: post() never takes a lock, and posts
+    // made before the worker has woken up from an earlier one are folded into it
+    class Wakeup
+    {
+    public:
+        Wakeup();
+        ~Wakeup();
+
+        void post();
+        // blocks until there has been a post since the last wait returned
+        void wait();
+
+    private:
+        struct Semaphore;
+        std::unique_ptr<Semaphore> semaphore;
+        std::atomic<bool> pending;
+    };
+
+    enum Stage
+    {
+        Idle,
+        Pending,
+        Busy,
+        Ready
+    };
+
+    class ChannelJob  : public juce::ThreadPoolJob
+    {
+    public:
+        explicit ChannelJob(SpectralWorker& owner);
+        JobStatus runJob() override;
+
+    private:
+        SpectralWorker& owner;
+    };
+
+    void run() override;
+    void prepareRolling();
+    void transformSnapshot();
+    void drainHistory();
+    void analyseHistory();
+    void transformChannels(const juce::AudioSampleBuffer& input, int inputStart, juce::AudioSampleBuffer& ringOut,
+                           int outputStart, juce::AudioSampleBuffer* loopOut,
+                           const SpectralSnapshot* recalled, bool captureMagnitudes);
+    void claimChannels();
+    void transform(SpectralCache::FftPlan& plan, juce::uint32 phaseKey, const float* input, int inputStart,
+                   float* ringOut, int outputStart, float* loopOut);
+    void resynthesise(SpectralCache::FftPlan& plan, juce::uint32 phaseKey, const float* magnitudes,
+                      float* ringOut, int outputStart, float* loopOut);
+
+    std::atomic<int> stage;
+    Wakeup wakeup;
+    juce::AudioSampleBuffer snapshot;
+    juce::AudioSampleBuffer result;
+    juce::AudioSampleBuffer loopResult;
+    // message thread: whether loopResult and the rolling buffers are sized yet
+    bool loopPrepared;
+    bool rollingPrepared;
+    juce::SharedResourcePointer<SpectralCache> cache;
+    // phaseSeed is only read by prepare(), which hands it to the worker as drawSeed
+    juce::uint64 phaseSeed;
+    juce::uint64 drawSeed;
+    juce::uint64 drawCount;
+    const float* window;
+    const float* complement;
+    int numChannels;
+    int bufferSize;
+    int fftSize;
+    int fftOrder;
+    int snapshotStart;
+    bool loopRequested;
+    const SpectralSnapshot* recallSnapshot;
+    bool synchronous;
+    juce::int64 lastTransformTicks;
+
+    // rolling analysis: audio thread -> fifo -> history, analysed into rolling*
+    // and published to the audio thread by swapping with published* under publishLock
+    std::atomic<bool> rollingEnabled;
+    juce::AbstractFifo historyFifo;
+    juce::AudioSampleBuffer fifoBuffer;
+    juce::AudioSampleBuffer history;
+    juce::AudioSampleBuffer rollingRing;
+    juce::AudioSampleBuffer rollingLoop;
+    juce::AudioSampleBuffer publishedRing;
+    juce::AudioSampleBuffer publishedLoop;
+    juce::SpinLock publishLock;
+    bool publishedReady;
+    int historyWriteIndex;
+    int historyFilled;
+    int samplesSinceAnalysis;
+    int rollingHop;
+
+    // the batch of channels being transformed, claimed one at a time by
+    // whichever of the worker and the pool threads gets there first
+    juce::ThreadPool* pool;
+    std::vector<std::unique_ptr<ChannelJob>> jobs;
+    const juce::AudioSampleBuffer* batchInput;
+    juce::AudioSampleBuffer* batchRing;
+    juce::AudioSampleBuffer* batchLoop;
+    int batchInputStart;
+    int batchOutputStart;
+    std::atomic<int> nextChannel;
+    std::atomic<int> channelsDone;
+    juce::WaitableEvent batchDone;
+    std::atomic<bool> sharedPhase;
+    bool batchSharedPhase;
+    juce::uint64 batchDraw;
+    std::vector<float> phaseField;
+    const SpectralSnapshot* batchRecall;
+    bool batchCapture;
+
+    // each channel's thread writes its magnitudes into capturing, which is swapped
+    // into frozenMagnitudes for the message thread once the whole batch is done
+    juce::AudioSampleBuffer capturingMagnitudes;
+    juce::AudioSampleBuffer frozenMagnitudes;
+    juce::SpinLock magnitudesLock;
+    bool magnitudesReady;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectralWorker)
+};
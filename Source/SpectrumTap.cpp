@@ -0,0 +1,83 @@
+#include "SpectrumTap.h"
+
+//==============================================================================
+SpectrumTap::SpectrumTap()
+    : magnitudeScale(1.0f),
+      fifo(fifoSize),
+      ring(fifoSize, 0.0f),
+      history(fftSize, 0.0f),
+      fftBuffer(fftSize * 2, 0.0f),
+      levels(numBins, minimumDb)
+{
+    fft = cache->acquireFft(fftOrder);
+    window = cache->getWindow(fftSize, juce::dsp::WindowingFunction<float>::hann);
+
+    // a full-scale sine peaks at half the window's sum
+    float windowSum = 0.0f;
+    for (int i = 0; i < fftSize; ++i)
+        windowSum += window->window[i];
+    magnitudeScale = 2.0f / windowSum;
+}
+
+//==============================================================================
+void SpectrumTap::push(const juce::AudioSourceChannelInfo& block)
+{
+    int numChannels = block.buffer->getNumChannels();
+    if (numChannels == 0) return;
+
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(block.numSamples, start1, size1, start2, size2);
+    if (size1 + size2 == 0) return;
+
+    float gain = 1.0f / static_cast<float>(numChannels);
+
+    auto mixInto = [&] (int ringStart, int size, int offset)
+    {
+        float* out = ring.data() + ringStart;
+        juce::FloatVectorOperations::copyWithMultiply(out, block.buffer->getReadPointer(0, block.startSample + offset), gain, size);
+        for (int channel = 1; channel < numChannels; ++channel)
+            juce::FloatVectorOperations::addWithMultiply(out, block.buffer->getReadPointer(channel, block.startSample + offset), gain, size);
+    };
+
+    mixInto(start1, size1, 0);
+    mixInto(start2, size2, size1);
+    fifo.finishedWrite(size1 + size2);
+}
+
+//==============================================================================
+bool SpectrumTap::update()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+    if (size1 + size2 == 0) return false;
+
+    append(ring.data() + start1, size1);
+    append(ring.data() + start2, size2);
+    fifo.finishedRead(size1 + size2);
+
+    float* data = fftBuffer.data();
+    juce::FloatVectorOperations::multiply(data, history.data(), window->window, fftSize);
+    juce::FloatVectorOperations::clear(data + fftSize, fftSize);
+    fft->fft.performFrequencyOnlyForwardTransform(data);
+
+    for (int bin = 0; bin < numBins; ++bin)
+    {
+        float db = juce::Decibels::gainToDecibels(data[bin] * magnitudeScale, minimumDb);
+        levels[static_cast<size_t>(bin)] = juce::jmax(db, levels[static_cast<size_t>(bin)] - fallDb);
+    }
+
+    return true;
+}
+
+void SpectrumTap::append(const float* samples, int numSamples)
+{
+    // only the newest frame is ever analysed
+    if (numSamples >= fftSize)
+    {
+        std::copy(samples + numSamples - fftSize, samples + numSamples, history.begin());
+        return;
+    }
+
+    std::copy(history.begin() + numSamples, history.end(), history.begin());
+    std::copy(samples, samples + numSamples, history.end() - numSamples);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SpectralCache.h"
+
+//==============================================================================
+/*
+    Carries what the engine plays from the audio thread to a spectrum display.
+
+    The audio thread pushes a mono mix of each block into a single-producer FIFO
+    and drops whatever doesn't fit, so it never waits on the GUI. The message
+    thread drains the FIFO, analyses the newest frame and keeps a level per bin
+    that rises at once and falls back slowly. While a freeze holds, that is the
+    spectrum of the frozen snapshot.
+*/
+class SpectrumTap
+{
+public:
+    //==============================================================================
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+    static constexpr int numBins = fftSize / 2 + 1;
+    // the floor of the display
+    static constexpr float minimumDb = -100.0f;
+
+    SpectrumTap();
+
+    // audio thread
+    void push(const juce::AudioSourceChannelInfo& block);
+
+    // message thread: take in everything pushed so far and re-analyse the newest
+    // frame. returns false, leaving the levels alone, if nothing new arrived
+    bool update();
+    // dB relative to a full-scale sine, one per bin, never below minimumDb
+    const float* getLevels() const { return levels.data(); }
+
+private:
+    // about 0.2 s at 44.1 kHz, enough to ride out a GUI that stalls for a few frames
+    static constexpr int fifoSize = 8192;
+    // how far a level falls per update once its bin has gone quiet
+    static constexpr float fallDb = 1.5f;
+
+    void append(const float* samples, int numSamples);
+
+    juce::SharedResourcePointer<SpectralCache> cache;
+    SpectralCache::FftPlan::Ptr fft;
+    SpectralCache::WindowTable::Ptr window;
+    float magnitudeScale;
+
+    juce::AbstractFifo fifo;
+    std::vector<float> ring;
+    std::vector<float> history;
+    std::vector<float> fftBuffer;
+    std::vector<float> levels;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumTap)
+};
@@ -0,0 +1,294 @@
+#include "StftFreeze.h"
+#include "FreezeKernels.h"
+#include "SpectralUtils.h"
+
+//==============================================================================
+StftFreeze::StftFreeze()
+    : phaseSeed(SpectralUtils::makeRandomSeed()),
+      frameCount(0),
+      frameSize(0),
+      hopSize(0),
+      accumulatorIndex(0),
+      samplesUntilHop(0),
+      sharedPhase(false),
+      numActiveLayers(0)
+{
+    clearLayers();
+}
+
+void StftFreeze::prepare(int numChannels, int newFrameSize, int newHopSize,
+                         juce::dsp::WindowingFunction<float>::WindowingMethod windowType)
+{
+    jassert(juce::isPowerOfTwo(newFrameSize) && newFrameSize % newHopSize == 0);
+
+    frameSize = newFrameSize;
+    hopSize = newHopSize;
+    // hand the old plan back first so a same-sized one can simply be reused
+    fft = nullptr;
+    fft = cache->acquireFft(static_cast<int>(std::log2(frameSize)));
+    fftBuffer.assign(frameSize * 2, 0.0f);
+    scratch.assign(frameSize, 0.0f);
+    phaseField.assign(frameSize + 2, 0.0f);
+    frameCount = 0;
+    magnitudes.setSize(numChannels, SpectralUtils::getNumBins(frameSize));
+    accumulator.setSize(numChannels, frameSize);
+    layerPowers.setSize(maxLayers * numChannels, SpectralUtils::getNumBins(frameSize));
+    magnitudes.clear();
+    accumulator.clear();
+    clearLayers();
+
+    analysisWindow = cache->getWindow(frameSize, windowType);
+    const float* window = analysisWindow->window;
+
+    // frames carry independent random phase, so overlapping them adds power rather
+    // than amplitude: with w the window, each frame comes out at mean(w^2) of the
+    // input power and frameSize / hopSize of them overlap at any one sample
+    float meanSquare = 0.0f;
+    for (int i = 0; i < frameSize; ++i)
+        meanSquare += window[i] * window[i];
+    meanSquare /= static_cast<float>(frameSize);
+
+    float gain = 1.0f / (meanSquare * std::sqrt(static_cast<float>(frameSize) / static_cast<float>(hopSize)));
+    synthesisWindow.resize(frameSize);
+    juce::FloatVectorOperations::multiply(synthesisWindow.data(), window, gain, frameSize);
+
+    accumulatorIndex = 0;
+    samplesUntilHop = 0;
+}
+
+//==============================================================================
+void StftFreeze::capture(const juce::AudioSampleBuffer& ring, int endIndex)
+{
+    clearLayers();
+    analyseLayer(0, ring, endIndex);
+    layerActive[0] = true;
+    layerGain[0] = 1.0f;
+    layerTarget[0] = 1.0f;
+    numActiveLayers = 1;
+    combineLayers();
+
+    // pretend frames have been running all along: lay down the tails of the
+    // frames that would have started one, two, ... hops ago
+    accumulator.clear();
+    accumulatorIndex = 0;
+
+    for (int skip = hopSize; skip < frameSize; skip += hopSize)
+        synthesiseFrames(accumulator.getNumChannels(), skip);
+
+    samplesUntilHop = 0;
+}
+
+int StftFreeze::addLayer(const juce::AudioSampleBuffer& ring, int endIndex, int fadeHops)
+{
+    // lowest free slot, else steal whichever layer is heading for the lowest gain
+    int layer = -1;
+    for (int i = 0; i < maxLayers && layer < 0; ++i)
+        if (! layerActive[i]) layer = i;
+
+    if (layer < 0)
+    {
+        layer = 0;
+        for (int i = 1; i < maxLayers; ++i)
+            if (layerTarget[i] < layerTarget[layer]
+                || (layerTarget[i] == layerTarget[layer] && layerGain[i] < layerGain[layer]))
+                layer = i;
+    }
+    else
+    {
+        ++numActiveLayers;
+    }
+
+    analyseLayer(layer, ring, endIndex);
+    layerActive[layer] = true;
+    layerGain[layer] = fadeHops > 0 ? 0.0f : 1.0f;
+    layerTarget[layer] = 1.0f;
+    layerStep[layer] = fadeHops > 0 ? 1.0f / static_cast<float>(fadeHops) : 0.0f;
+    combineLayers();
+    return layer;
+}
+
+void StftFreeze::fadeLayer(int layer, float gain, int fadeHops)
+{
+    if (layer < 0 || layer >= maxLayers || ! layerActive[layer]) return;
+
+    layerTarget[layer] = gain;
+    if (fadeHops > 0)
+    {
+        layerStep[layer] = (gain - layerGain[layer]) / static_cast<float>(fadeHops);
+        return;
+    }
+
+    // jump straight there, freeing the slot if it is now silent
+    layerGain[layer] = gain;
+    layerStep[layer] = 0.0f;
+    if (gain <= 0.0f)
+    {
+        layerActive[layer] = false;
+        --numActiveLayers;
+    }
+    combineLayers();
+}
+
+void StftFreeze::fadeOutLayers(int fadeHops)
+{
+    for (int layer = 0; layer < maxLayers; ++layer)
+        fadeLayer(layer, 0.0f, fadeHops);
+}
+
+void StftFreeze::clearLayers()
+{
+    for (int layer = 0; layer < maxLayers; ++layer)
+    {
+        layerGain[layer] = 0.0f;
+        layerTarget[layer] = 0.0f;
+        layerStep[layer] = 0.0f;
+        layerActive[layer] = false;
+    }
+
+    numActiveLayers = 0;
+    magnitudes.clear();
+}
+
+void StftFreeze::addTo(juce::AudioSampleBuffer& buffer, int startSample, int numSamples, const float* gains)
+{
+    int numChannels = juce::jmin(buffer.getNumChannels(), accumulator.getNumChannels());
+    int done = 0;
+
+    while (done < numSamples)
+    {
+        if (samplesUntilHop == 0)
+        {
+            advanceLayers();
+
+            // with nothing left to play the tails already in the accumulator just run out
+            if (numActiveLayers > 0)
+                synthesiseFrames(numChannels, 0);
+
+            samplesUntilHop = hopSize;
+        }
+
+        int span = juce::jmin(numSamples - done, samplesUntilHop);
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            float* out = buffer.getWritePointer(channel, startSample + done);
+            float* accum = accumulator.getWritePointer(channel);
+
+            if (gains != nullptr)
+                FreezeKernels::addFromRingWithMultiply(out, accum, frameSize, accumulatorIndex, gains + done, span);
+            else
+                FreezeKernels::addFromRing(out, accum, frameSize, accumulatorIndex, span);
+
+            // what has been played is free for the next frame's tail
+            FreezeKernels::clearRing(accum, frameSize, accumulatorIndex, span);
+        }
+
+        accumulatorIndex = FreezeKernels::wrap(accumulatorIndex, span, frameSize);
+        samplesUntilHop -= span;
+        done += span;
+    }
+}
+
+//==============================================================================
+void StftFreeze::analyseLayer(int layer, const juce::AudioSampleBuffer& ring, int endIndex)
+{
+    int ringSize = ring.getNumSamples();
+    jassert(ringSize >= frameSize);
+    int frameStart = (endIndex - frameSize + ringSize) % ringSize;
+    int numChannels = magnitudes.getNumChannels();
+    float* data = fftBuffer.data();
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        // take the most recent frame, window it and keep only its power spectrum
+        FreezeKernels::copyFromRing(data, ring.getReadPointer(juce::jmin(channel, ring.getNumChannels() - 1)),
+                                    ringSize, frameStart, frameSize);
+        juce::FloatVectorOperations::multiply(data, analysisWindow->window, frameSize);
+        juce::FloatVectorOperations::clear(data + frameSize, frameSize);
+
+        fft->fft.performRealOnlyForwardTransform(data);
+        SpectralUtils::computePowers(data, layerPowers.getWritePointer(layer * numChannels + channel), frameSize);
+    }
+}
+
+void StftFreeze::advanceLayers()
+{
+    bool changed = false;
+
+    for (int layer = 0; layer < maxLayers; ++layer)
+    {
+        if (! layerActive[layer]) continue;
+
+        if (layerGain[layer] != layerTarget[layer])
+        {
+            layerGain[layer] += layerStep[layer];
+            bool arrived = layerStep[layer] >= 0.0f ? layerGain[layer] >= layerTarget[layer]
+                                                    : layerGain[layer] <= layerTarget[layer];
+            if (arrived) layerGain[layer] = layerTarget[layer];
+            changed = true;
+        }
+
+        if (layerGain[layer] <= 0.0f && layerTarget[layer] <= 0.0f)
+        {
+            layerActive[layer] = false;
+            --numActiveLayers;
+            changed = true;
+        }
+    }
+
+    if (changed)
+        combineLayers();
+}
+
+void StftFreeze::combineLayers()
+{
+    // layers carry independent random phase, so what adds up is their power:
+    // |X|^2 = sum of gain^2 * |X_layer|^2, one magnitude spectrum for all of them
+    int numChannels = magnitudes.getNumChannels();
+    int numBins = magnitudes.getNumSamples();
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        float* combined = magnitudes.getWritePointer(channel);
+        juce::FloatVectorOperations::clear(combined, numBins);
+
+        for (int layer = 0; layer < maxLayers; ++layer)
+            if (layerActive[layer])
+                juce::FloatVectorOperations::addWithMultiply(combined, layerPowers.getReadPointer(layer * numChannels + channel),
+                                                             layerGain[layer] * layerGain[layer], numBins);
+
+        for (int bin = 0; bin < numBins; ++bin)
+            combined[bin] = std::sqrt(combined[bin]);
+    }
+}
+
+void StftFreeze::synthesiseFrames(int numChannels, int skip)
+{
+    float* data = fftBuffer.data();
+    int length = frameSize - skip;
+
+    if (sharedPhase)
+        SpectralUtils::generatePhaseField(phaseField.data(), frameSize, SpectralUtils::getPhaseKey(phaseSeed, frameCount, 0));
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const float* frameMagnitudes = magnitudes.getReadPointer(channel);
+
+        // DC and Nyquist have no phase to randomise
+        data[0] = frameMagnitudes[0];
+        data[frameSize] = frameMagnitudes[frameSize / 2];
+        if (sharedPhase)
+            SpectralUtils::applyPhaseField(data, frameMagnitudes, phaseField.data(), frameSize);
+        else
+            SpectralUtils::randomisePhase(data, frameMagnitudes, frameSize,
+                                          SpectralUtils::getPhaseKey(phaseSeed, frameCount, channel));
+
+        fft->fft.performRealOnlyInverseTransform(data);
+
+        // window and overlap-add, dropping the first `skip` samples of the frame
+        juce::FloatVectorOperations::multiply(scratch.data(), data + skip, synthesisWindow.data() + skip, length);
+        FreezeKernels::addToRing(accumulator.getWritePointer(channel), frameSize, accumulatorIndex, scratch.data(), length);
+    }
+
+    ++frameCount;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <juce_dsp/juce_dsp.h>
+#include "SpectralCache.h"
+
+//==============================================================================
+/*
+    Streaming alternative to the single-FFT frozen loop.
+
+    capture() keeps the magnitude spectrum of one short windowed frame per
+    channel. From then on every hop a new frame is resynthesised with fresh
+    random phase and overlap-added into the output, so the cost is one small
+    inverse FFT per channel per hop rather than one huge transform per freeze,
+    and the memory is a few frames rather than a whole ring.
+
+    Freezes can also be stacked as layers, each kept as the power spectrum of
+    its frame with its own gain. Layers have independent random phase, so they
+    combine as a sum of powers into one magnitude spectrum per hop, and however
+    many are playing there is still only one inverse FFT per channel per hop.
+*/
+class StftFreeze
+{
+public:
+    //==============================================================================
+    static constexpr int maxLayers = 8;
+
+    StftFreeze();
+
+    // frameSize must be a power of two and a multiple of hopSize
+    void prepare(int numChannels, int frameSize, int hopSize,
+                 juce::dsp::WindowingFunction<float>::WindowingMethod windowType);
+
+    //==============================================================================
+    // audio thread: analyse the frameSize samples of `ring` that end just before
+    // `endIndex` and prime the overlap-add so output starts at full level.
+    // replaces any layers
+    void capture(const juce::AudioSampleBuffer& ring, int endIndex);
+
+    // audio thread: analyse a frame as above into a new layer that fades up to
+    // full gain over `fadeHops` hops. takes the lowest free slot, or the quietest
+    // layer if all are in use, and returns the slot
+    int addLayer(const juce::AudioSampleBuffer& ring, int endIndex, int fadeHops);
+    // audio thread: ramp one layer's gain over `fadeHops` hops; at zero it is freed
+    void fadeLayer(int layer, float gain, int fadeHops);
+    void fadeOutLayers(int fadeHops);
+    void clearLayers();
+    bool hasActiveLayers() const { return numActiveLayers > 0; }
+
+    // audio thread: add the next numSamples of resynthesis into `buffer`, each
+    // sample scaled by `gains` (or unscaled when gains is null)
+    void addTo(juce::AudioSampleBuffer& buffer, int startSample, int numSamples, const float* gains);
+
+    // same random phases for every channel of a frame (see SpectralWorker::setSharedPhase)
+    void setSharedPhase(bool shouldShare) { sharedPhase = shouldShare; }
+    // the seed frames draw their phases from (see SpectralWorker::setPhaseSeed)
+    void setPhaseSeed(juce::uint64 seed) { phaseSeed = seed; }
+
+    int getFrameSize() const { return frameSize; }
+    int getHopSize() const { return hopSize; }
+
+private:
+    void analyseLayer(int layer, const juce::AudioSampleBuffer& ring, int endIndex);
+    void advanceLayers();
+    void combineLayers();
+    void synthesiseFrames(int numChannels, int skip);
+
+    juce::SharedResourcePointer<SpectralCache> cache;
+    SpectralCache::FftPlan::Ptr fft;
+    SpectralCache::WindowTable::Ptr analysisWindow;
+    std::vector<float> synthesisWindow;
+    std::vector<float> fftBuffer;
+    std::vector<float> scratch;
+    std::vector<float> phaseField;
+    juce::AudioSampleBuffer magnitudes;
+    juce::AudioSampleBuffer accumulator;
+    juce::uint64 phaseSeed;
+    juce::uint64 frameCount;
+    int frameSize;
+    int hopSize;
+    int accumulatorIndex;
+    int samplesUntilHop;
+    bool sharedPhase;
+
+    // layer l, channel c lives in channel l * numChannels + c
+    juce::AudioSampleBuffer layerPowers;
+    float layerGain[maxLayers];
+    float layerTarget[maxLayers];
+    float layerStep[maxLayers];
+    bool layerActive[maxLayers];
+    int numActiveLayers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StftFreeze)
+};
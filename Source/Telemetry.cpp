@@ -0,0 +1,173 @@
+#include "Telemetry.h"
+
+//==============================================================================
+void Telemetry::Histogram::add(double micros)
+{
+    int bucket = 0;
+    while (bucket < numBuckets - 1 && micros >= getBucketEnd(bucket))
+        ++bucket;
+
+    ++counts[bucket];
+    ++total;
+    sumMicros += micros;
+    maxMicros = juce::jmax(maxMicros, micros);
+}
+
+//==============================================================================
+Telemetry::Telemetry()
+    : juce::Thread("Telemetry"),
+      fifo(ringSize),
+      dropped(0),
+      sampleRate(0.0)
+{
+}
+
+Telemetry::~Telemetry()
+{
+    release();
+}
+
+void Telemetry::prepare(double newSampleRate, bool useThread)
+{
+    release();
+    sampleRate = newSampleRate;
+    if (useThread)
+        startThread();
+}
+
+void Telemetry::release()
+{
+    stopThread(1000);
+    drain();
+}
+
+//==============================================================================
+void Telemetry::recordCallback(Branch branch, int numSamples, juce::int64 ticks)
+{
+    push({ CallbackEvent, branch, numSamples, ticks });
+}
+
+void Telemetry::recordTransform(juce::int64 ticks)
+{
+    push({ TransformEvent, 0, 0, ticks });
+}
+
+void Telemetry::recordFreezeLatency(juce::int64 ticks)
+{
+    push({ FreezeLatencyEvent, 0, 0, ticks });
+}
+
+void Telemetry::push(const Event& event)
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToWrite(1, start1, size1, start2, size2);
+
+    if (size1 == 0)
+    {
+        ++dropped;
+        return;
+    }
+
+    ring[start1] = event;
+    fifo.finishedWrite(1);
+}
+
+//==============================================================================
+Telemetry::Snapshot Telemetry::getSnapshot() const
+{
+    const juce::ScopedLock sl(statsLock);
+    Snapshot copy = stats;
+    copy.dropped = dropped.load();
+    copy.sampleRate = sampleRate.load();
+    return copy;
+}
+
+void Telemetry::reset()
+{
+    const juce::ScopedLock sl(statsLock);
+    stats = Snapshot();
+    dropped = 0;
+}
+
+const char* Telemetry::getBranchName(Branch branch)
+{
+    switch (branch)
+    {
+        case Live:        return "live";
+        case Forecasting: return "forecasting";
+        case Frozen:      return "frozen";
+        case Thawing:     return "thawing";
+        case numBranches: break;
+    }
+
+    return "";
+}
+
+bool Telemetry::writeCsv(const juce::File& file) const
+{
+    Snapshot snapshot = getSnapshot();
+    juce::String csv = "metric,bucketStartMicros,bucketEndMicros,count\n";
+
+    auto addHistogram = [&csv] (const juce::String& name, const Histogram& histogram)
+    {
+        for (int bucket = 0; bucket < Histogram::numBuckets; ++bucket)
+            if (histogram.counts[bucket] > 0)
+                csv << name << "," << (bucket == 0 ? 0.0 : Histogram::getBucketEnd(bucket - 1)) << ","
+                    << Histogram::getBucketEnd(bucket) << "," << histogram.counts[bucket] << "\n";
+    };
+
+    for (int branch = 0; branch < numBranches; ++branch)
+        addHistogram(juce::String("callback.") + getBranchName(static_cast<Branch>(branch)), snapshot.callbacks[branch]);
+    addHistogram("transform", snapshot.transforms);
+    addHistogram("freezeLatency", snapshot.freezeLatency);
+
+    // counters have no bucket
+    csv << "deadlineMisses,,," << snapshot.deadlineMisses << "\n"
+        << "dropped,,," << snapshot.dropped << "\n";
+
+    return file.replaceWithText(csv);
+}
+
+//==============================================================================
+void Telemetry::run()
+{
+    while (! threadShouldExit())
+    {
+        drain();
+        wait(20);
+    }
+}
+
+void Telemetry::drain()
+{
+    int start1, size1, start2, size2;
+    fifo.prepareToRead(fifo.getNumReady(), start1, size1, start2, size2);
+    if (size1 + size2 == 0) return;
+
+    double rate = sampleRate.load();
+    const juce::ScopedLock sl(statsLock);
+
+    for (int i = 0; i < size1 + size2; ++i)
+    {
+        const Event& event = ring[i < size1 ? start1 + i : start2 + i - size1];
+        double micros = 1.0e6 * juce::Time::highResolutionTicksToSeconds(event.ticks);
+
+        switch (event.type)
+        {
+            case CallbackEvent:
+                stats.callbacks[event.branch].add(micros);
+                // a callback that takes longer than the audio it produces is an xrun waiting to happen
+                if (rate > 0.0 && micros > 1.0e6 * event.numSamples / rate)
+                    ++stats.deadlineMisses;
+                break;
+            case TransformEvent:
+                stats.transforms.add(micros);
+                break;
+            case FreezeLatencyEvent:
+                stats.freezeLatency.add(micros);
+                break;
+        }
+    }
+
+    fifo.finishedRead(size1 + size2);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/*
+    Real-time instrumentation for the freeze engine.
+
+    The audio thread records fixed-size events into a single-producer ring with
+    no locks and no allocation; if the ring is full the event is counted as
+    dropped instead. A background thread drains the ring into log-scaled
+    histograms, which any other thread can copy out with getSnapshot() to draw
+    or write to a CSV file.
+*/
+class Telemetry  : private juce::Thread
+{
+public:
+    // what the engine spent a callback doing
+    enum Branch
+    {
+        Live,
+        Forecasting,
+        Frozen,
+        Thawing,
+        numBranches
+    };
+
+    // counts of durations in power-of-two buckets: bucket 0 is under 1 us and
+    // bucket b > 0 covers [2^(b-1), 2^b) us, the last one everything longer
+    struct Histogram
+    {
+        static constexpr int numBuckets = 24;
+
+        void add(double micros);
+        static double getBucketEnd(int bucket) { return static_cast<double>(1 << bucket); }
+
+        int counts[numBuckets] = {};
+        int total = 0;
+        double sumMicros = 0.0;
+        double maxMicros = 0.0;
+    };
+
+    struct Snapshot
+    {
+        Histogram callbacks[numBranches];
+        Histogram transforms;
+        Histogram freezeLatency;
+        int deadlineMisses = 0;
+        int dropped = 0;
+        double sampleRate = 0.0;
+    };
+
+    //==============================================================================
+    Telemetry();
+    ~Telemetry() override;
+
+    // starts the drain thread; block deadlines are worked out at `sampleRate`.
+    // without `useThread` nothing drains the ring until drain() is called
+    // (offline rendering, where the recording thread has time to spare)
+    void prepare(double sampleRate, bool useThread = true);
+    void release();
+    // moves everything recorded so far into the histograms; only ever from one
+    // thread, and not while the drain thread is running
+    void drain();
+
+    //==============================================================================
+    // audio thread
+    void recordCallback(Branch branch, int numSamples, juce::int64 ticks);
+    void recordTransform(juce::int64 ticks);
+    void recordFreezeLatency(juce::int64 ticks);
+
+    //==============================================================================
+    // any thread
+    Snapshot getSnapshot() const;
+    void reset();
+    // one row per non-empty bucket of every histogram, plus the counters
+    bool writeCsv(const juce::File& file) const;
+
+    static const char* getBranchName(Branch branch);
+
+private:
+    enum EventType
+    {
+        CallbackEvent,
+        TransformEvent,
+        FreezeLatencyEvent
+    };
+
+    struct Event
+    {
+        EventType type;
+        int branch;
+        int numSamples;
+        juce::int64 ticks;
+    };
+
+    static constexpr int ringSize = 4096;
+
+    void push(const Event& event);
+    void run() override;
+
+    juce::AbstractFifo fifo;
+    Event ring[ringSize];
+    std::atomic<int> dropped;
+
+    juce::CriticalSection statsLock;
+    Snapshot stats;
+    std::atomic<double> sampleRate;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (Telemetry)
+};
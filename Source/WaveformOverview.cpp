@@ -0,0 +1,175 @@
+#include "WaveformOverview.h"
+
+//==============================================================================
+WaveformOverview::WaveformOverview()
+    : lengthInSamples(0),
+      sampleRate(0.0),
+      decoded(0),
+      ready(0),
+      complete(false)
+{
+}
+
+bool WaveformOverview::load(juce::AudioFormatManager& formatManager, const juce::File& file)
+{
+    clear();
+
+    // a reader of its own, so the overview never seeks the one playback streams from
+    reader.reset(formatManager.createReaderFor(file));
+    if (reader == nullptr || reader->lengthInSamples <= 0 || reader->numChannels == 0)
+    {
+        reader = nullptr;
+        return false;
+    }
+
+    lengthInSamples = reader->lengthInSamples;
+    sampleRate = reader->sampleRate;
+    decodeBuffer.setSize(static_cast<int>(reader->numChannels), binsPerSlice * binSamples);
+
+    // every level is sized up front, nothing is allocated while the GUI reads
+    int numBins = static_cast<int>((lengthInSamples + binSamples - 1) / binSamples);
+    for (int size = numBins; ; size = (size + 1) / 2)
+    {
+        levels.emplace_back(static_cast<size_t>(size));
+        if (size == 1) break;
+    }
+
+    return true;
+}
+
+void WaveformOverview::clear()
+{
+    reader = nullptr;
+    levels.clear();
+    lengthInSamples = 0;
+    sampleRate = 0.0;
+    decoded = 0;
+    ready = 0;
+    complete = false;
+}
+
+//==============================================================================
+bool WaveformOverview::getRange(juce::int64 startSample, juce::int64 endSample, float& low, float& high) const
+{
+    if (levels.empty()) return false;
+
+    startSample = juce::jlimit<juce::int64>(0, lengthInSamples - 1, startSample);
+    endSample = juce::jlimit<juce::int64>(startSample + 1, lengthInSamples, endSample);
+
+    // the coarsest bins no longer than the range, so it never touches more than three
+    int level = 0;
+    while (level + 1 < static_cast<int>(levels.size())
+           && (static_cast<juce::int64>(binSamples) << (level + 1)) <= endSample - startSample)
+        ++level;
+
+    juce::int64 binSize = static_cast<juce::int64>(binSamples) << level;
+    int first = static_cast<int>(startSample / binSize);
+    int last = juce::jmin(static_cast<int>((endSample - 1) / binSize), getNumReady(level) - 1);
+    if (first > last) return false;
+
+    const std::vector<Bin>& bins = levels[static_cast<size_t>(level)];
+    low = bins[static_cast<size_t>(first)].low;
+    high = bins[static_cast<size_t>(first)].high;
+    for (int bin = first + 1; bin <= last; ++bin)
+    {
+        low = juce::jmin(low, bins[static_cast<size_t>(bin)].low);
+        high = juce::jmax(high, bins[static_cast<size_t>(bin)].high);
+    }
+
+    return true;
+}
+
+int WaveformOverview::getNumReady(int level) const
+{
+    if (complete.load(std::memory_order_acquire))
+        return static_cast<int>(levels[static_cast<size_t>(level)].size());
+
+    return ready.load(std::memory_order_acquire) >> level;
+}
+
+//==============================================================================
+int WaveformOverview::useTimeSlice()
+{
+    if (reader == nullptr || complete.load()) return -1;
+
+    int firstBin = static_cast<int>(decoded / binSamples);
+    int numSamples = static_cast<int>(juce::jmin<juce::int64>(decodeBuffer.getNumSamples(), lengthInSamples - decoded));
+    if (! reader->read(&decodeBuffer, 0, numSamples, decoded, true, true))
+        decodeBuffer.clear(0, numSamples);
+
+    int numBins = (numSamples + binSamples - 1) / binSamples;
+    std::vector<Bin>& bins = levels[0];
+
+    for (int i = 0; i < numBins; ++i)
+    {
+        int start = i * binSamples;
+        int count = juce::jmin(binSamples, numSamples - start);
+        Bin bin { std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest() };
+
+        for (int channel = 0; channel < decodeBuffer.getNumChannels(); ++channel)
+        {
+            auto range = juce::FloatVectorOperations::findMinAndMax(decodeBuffer.getReadPointer(channel, start), count);
+            bin.low = juce::jmin(bin.low, range.getStart());
+            bin.high = juce::jmax(bin.high, range.getEnd());
+        }
+
+        bins[static_cast<size_t>(firstBin + i)] = bin;
+    }
+
+    decoded += numSamples;
+    extendLevels(firstBin, numBins);
+
+    // the last slice may end in a partial bin, which only the finished overview shows
+    if (decoded >= lengthInSamples)
+    {
+        finishLevels();
+        complete.store(true, std::memory_order_release);
+        reader = nullptr;
+        return -1;
+    }
+
+    ready.store(firstBin + numBins, std::memory_order_release);
+
+    // leave the read-ahead of the file being played a look in between slices
+    return 1;
+}
+
+void WaveformOverview::extendLevels(int firstBin, int numBins)
+{
+    // a bin on level k is complete once every level-0 bin under it is, i.e. below end >> k.
+    // none of the bins written here has been published yet
+    int end = firstBin + numBins;
+
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        const std::vector<Bin>& below = levels[level - 1];
+        std::vector<Bin>& bins = levels[level];
+
+        for (int bin = firstBin >> level; bin < end >> level; ++bin)
+        {
+            const Bin& left = below[static_cast<size_t>(2 * bin)];
+            const Bin& right = below[static_cast<size_t>(2 * bin + 1)];
+            bins[static_cast<size_t>(bin)] = { juce::jmin(left.low, right.low), juce::jmax(left.high, right.high) };
+        }
+    }
+}
+
+void WaveformOverview::finishLevels()
+{
+    // the bins past the last complete one on each level, where a pair may be a single bin
+    int numBins = static_cast<int>(levels[0].size());
+
+    for (size_t level = 1; level < levels.size(); ++level)
+    {
+        const std::vector<Bin>& below = levels[level - 1];
+        std::vector<Bin>& bins = levels[level];
+
+        for (size_t bin = static_cast<size_t>(numBins >> level); bin < bins.size(); ++bin)
+        {
+            Bin merged = below[2 * bin];
+            if (2 * bin + 1 < below.size())
+                merged = { juce::jmin(merged.low, below[2 * bin + 1].low), juce::jmax(merged.high, below[2 * bin + 1].high) };
+            bins[bin] = merged;
+        }
+    }
+}
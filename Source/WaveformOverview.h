@@ -0,0 +1,72 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+
+//==============================================================================
+/*
+    Min/max overview of a whole audio file, built as a pyramid so any stretch of
+    it can be drawn at the same cost however long the file is.
+
+    Level 0 holds the lowest and highest sample of every binSamples samples,
+    across all channels, and each level above merges pairs of bins from the one
+    below. The file is decoded a chunk per time slice on a TimeSliceThread, and
+    every level is extended as soon as both halves of a bin are in, so the
+    overview fills in from the start while the file is still being read. Ready
+    bins are published with an atomic count: the GUI reads only what has been
+    published and never waits on the decoder.
+*/
+class WaveformOverview  : public juce::TimeSliceClient
+{
+public:
+    //==============================================================================
+    WaveformOverview();
+
+    // message thread, with this client off its TimeSliceThread: drop the current
+    // overview and size one for `file`. returns false if it can't be read
+    bool load(juce::AudioFormatManager& formatManager, const juce::File& file);
+    void clear();
+
+    //==============================================================================
+    // message thread
+    juce::int64 getLengthInSamples() const { return lengthInSamples; }
+    double getSampleRate() const { return sampleRate; }
+    bool isComplete() const { return complete.load(std::memory_order_acquire); }
+
+    // lowest and highest sample between startSample and endSample, read from the
+    // coarsest level whose bins still fit within the range. returns false if
+    // nothing there has been decoded yet
+    bool getRange(juce::int64 startSample, juce::int64 endSample, float& low, float& high) const;
+
+    //==============================================================================
+    int useTimeSlice() override;
+
+private:
+    struct Bin
+    {
+        float low;
+        float high;
+    };
+
+    static constexpr int binSamples = 256;
+    // level-0 bins decoded per time slice
+    static constexpr int binsPerSlice = 64;
+
+    int getNumReady(int level) const;
+    void extendLevels(int firstBin, int numBins);
+    void finishLevels();
+
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::AudioSampleBuffer decodeBuffer;
+    std::vector<std::vector<Bin>> levels;
+    juce::int64 lengthInSamples;
+    double sampleRate;
+    juce::int64 decoded;
+
+    // level-0 bins the GUI may read; level k has (ready >> k) of its bins in
+    std::atomic<int> ready;
+    // every level is filled, partial bins at the end included
+    std::atomic<bool> complete;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WaveformOverview)
+};